@@ -0,0 +1,685 @@
+#include "engine/asset.hpp"
+#include "engine/meshbuild.hpp"
+#include "engine/timer.hpp"
+
+#include <iostream>
+#include <cstddef>
+#include <algorithm>
+
+using namespace engine;
+
+namespace
+{
+    /* Copy up to budget bytes of data, continuing from uploaded, into an
+     * arena range starting at byte base; returns the bytes copied
+     */
+    size_t uploadSlice(bufferarena &arena, size_t base, const void *data,
+            size_t size, size_t &uploaded, size_t budget)
+    {
+        size_t slice = std::min(size - uploaded, budget);
+        if(slice > 0)
+        {
+            arena.write(base + uploaded, static_cast<const char*>(data) + uploaded,
+                    slice);
+            uploaded += slice;
+        }
+        return slice;
+    }
+
+    /* Planes bounding the clip volume of a combined transform, in the
+     * space it transforms from; p is inside when dot(xyz, p) + w >= 0 for
+     * every plane
+     */
+    void frustumPlanes(glm::mat4 transform, glm::vec4 planes[6])
+    {
+        glm::mat4 rows = glm::transpose(transform);
+        for(int i = 0; i < 3; i++)
+        {
+            planes[2*i] = rows[3] + rows[i];
+            planes[2*i + 1] = rows[3] - rows[i];
+        }
+    }
+
+    bool sphereInFrustum(const glm::vec4 planes[6], glm::vec3 center, float radius)
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal(planes[i]);
+            if(glm::dot(normal, center) + planes[i].w < -radius*glm::length(normal))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* largest length a unit vector in model space has in world space */
+    float maximumScale(glm::mat4 modelMatrix)
+    {
+        glm::mat3 linear(modelMatrix);
+        return std::max(glm::length(linear[0]),
+                std::max(glm::length(linear[1]), glm::length(linear[2])));
+    }
+}
+
+drawstats::drawstats() :
+    triangles(0),
+    meshlets(0),
+    culledMeshlets(0),
+    commands(0),
+    instances(0),
+    culledInstances(0)
+{}
+
+drawstats &drawstats::operator+=(const drawstats &s)
+{
+    triangles += s.triangles;
+    meshlets += s.meshlets;
+    culledMeshlets += s.culledMeshlets;
+    commands += s.commands;
+    instances += s.instances;
+    culledInstances += s.culledInstances;
+    return *this;
+}
+
+asset::asset(std::string filepath) :
+    filepath(filepath),
+    geometry(new meshcache()),
+    replacement(),
+    pool(0),
+    firstVertex(0),
+    firstIndex(0),
+    firstMaterial(0),
+    packed(),
+    vertexBufferSize(0),
+    positionOffset(),
+    positionScale(1.0f),
+    state(pending),
+    loadOnce(),
+    rangesAllocated(false),
+    vertexBytesUploaded(0),
+    indexBytesUploaded(0),
+    reloadState(idle),
+    reloadPath(),
+    replacementPacked(),
+    reloadRangesAllocated(false),
+    reloadPool(0),
+    reloadFirstVertex(0),
+    reloadFirstIndex(0),
+    reloadVertexBytesUploaded(0),
+    reloadIndexBytesUploaded(0),
+    levelInstances(),
+    runCounts(),
+    runFirsts(),
+    rangeRuns()
+{}
+
+asset::~asset()
+{
+    if(rangesAllocated)
+    {
+        releaseRanges();
+    }
+    if(reloadRangesAllocated)
+    {
+        reloadPool->vertices().release(reloadFirstVertex, replacement->vertexCount());
+        reloadPool->indices().release(reloadFirstIndex, replacement->indexCount());
+    }
+}
+
+bool asset::load()
+{
+    std::call_once(loadOnce, [this]() {
+        state = loadMesh(filepath, *geometry) ? loaded : failed;
+    });
+    return state != failed;
+}
+
+void asset::upload()
+{
+    upload(size_t(-1));
+}
+
+size_t asset::upload(size_t byteBudget)
+{
+    if(state != loaded)
+    {
+        return 0;
+    }
+
+    if(!rangesAllocated)
+    {
+        initRanges();
+        rangesAllocated = true;
+    }
+
+    // Stream the next slice of each range
+    bool compact = pool->isCompact();
+    const void *vertexData = geometry->isCompact() ?
+        static_cast<const void*>(geometry->packedVertices()) :
+        compact ? static_cast<const void*>(&packed[0]) : geometry->vertices();
+    size_t indexBufferSize = geometry->indexCount()*geometry->indexSize();
+    size_t vertexSize = compact ? sizeof(compactvertex) : sizeof(vertex);
+    size_t used = uploadSlice(pool->vertices(), firstVertex*vertexSize, vertexData,
+            vertexBufferSize, vertexBytesUploaded, byteBudget);
+    used += uploadSlice(pool->indices(), firstIndex*geometry->indexSize(),
+            geometry->indices(), indexBufferSize, indexBytesUploaded, byteBudget - used);
+
+    if(vertexBytesUploaded == vertexBufferSize &&
+            indexBytesUploaded == indexBufferSize)
+    {
+        std::vector<compactvertex>().swap(packed);
+        state = resident;
+        std::cout << filepath << ": " << (vertexBufferSize + indexBufferSize)/1024
+            << " KB of pooled GPU buffers (" << (compact ? "compact" : "float")
+            << " vertices)\n";
+    }
+    return used;
+}
+
+bool asset::isLoaded() const
+{
+    return state == loaded || state == resident;
+}
+
+bool asset::isResident() const
+{
+    return state == resident;
+}
+
+bool asset::hasFailed() const
+{
+    return state == failed;
+}
+
+bool asset::reload(workerpool &workers, std::string source)
+{
+    int expected = idle;
+    if(state != resident || !reloadState.compare_exchange_strong(expected, building))
+    {
+        return false;
+    }
+    reloadPath = source;
+    workers.submit([this]() {
+        rebuild();
+    });
+    return true;
+}
+
+void asset::rebuild()
+{
+    // The current geometry stays untouched until applyReload swaps
+    std::unique_ptr<meshcache> rebuilt(new meshcache());
+    if(!loadMesh(reloadPath, *rebuilt))
+    {
+        std::cout << reloadPath << ": reload failed, keeping the loaded mesh\n";
+        reloadState = idle;
+        return;
+    }
+    replacement.swap(rebuilt);
+    reloadState = built;
+}
+
+size_t asset::applyReload(size_t byteBudget)
+{
+    if(reloadState != built)
+    {
+        return 0;
+    }
+
+    // Lay out the new vertices as initRanges would
+    const meshcache &next = *replacement;
+    bool nextCompact = next.isCompact() || (compactVertices && next.vertexCount() > 0);
+    if(nextCompact && !next.isCompact() && replacementPacked.empty())
+    {
+        packvertices(next.vertices(), next.vertexCount(), next.boundsMin(),
+                next.boundsMax(), replacementPacked);
+    }
+    const void *vertexData = next.isCompact() ?
+        static_cast<const void*>(next.packedVertices()) :
+        nextCompact ? static_cast<const void*>(&replacementPacked[0]) : next.vertices();
+    size_t vertexSize = nextCompact ? sizeof(compactvertex) : sizeof(vertex);
+    size_t nextVertexSize = next.vertexCount()*vertexSize;
+    size_t nextIndexSize = next.indexCount()*next.indexSize();
+    geometrypool &nextPool = geometrypool::forLayout(nextCompact, next.indexSize());
+
+    size_t used = 0;
+    if(&nextPool == pool && next.vertexCount() == geometry->vertexCount() &&
+            next.indexCount() == geometry->indexCount())
+    {
+        // Same layout and sizes: overwrite the ranges instances draw from
+        // in place
+        size_t vertexBytes = 0, indexBytes = 0;
+        uploadSlice(pool->vertices(), firstVertex*vertexSize, vertexData,
+                nextVertexSize, vertexBytes, nextVertexSize);
+        uploadSlice(pool->indices(), firstIndex*next.indexSize(), next.indices(),
+                nextIndexSize, indexBytes, nextIndexSize);
+        used = nextVertexSize + nextIndexSize;
+        geometrypool::materials().release(firstMaterial, geometry->materialCount());
+    }
+    else
+    {
+        // Other sizes: fill new ranges while the old ones keep drawing
+        if(!reloadRangesAllocated)
+        {
+            reloadPool = &nextPool;
+            reloadFirstVertex = nextPool.vertices().allocate(next.vertexCount());
+            reloadFirstIndex = nextPool.indices().allocate(next.indexCount());
+            reloadRangesAllocated = true;
+            reloadVertexBytesUploaded = reloadIndexBytesUploaded = 0;
+        }
+        used = uploadSlice(reloadPool->vertices(), reloadFirstVertex*vertexSize,
+                vertexData, nextVertexSize, reloadVertexBytesUploaded, byteBudget);
+        used += uploadSlice(reloadPool->indices(), reloadFirstIndex*next.indexSize(),
+                next.indices(), nextIndexSize, reloadIndexBytesUploaded,
+                byteBudget - used);
+        if(reloadVertexBytesUploaded < nextVertexSize ||
+                reloadIndexBytesUploaded < nextIndexSize)
+        {
+            return used;
+        }
+
+        releaseRanges();
+        pool = reloadPool;
+        firstVertex = reloadFirstVertex;
+        firstIndex = reloadFirstIndex;
+        reloadRangesAllocated = false;
+    }
+
+    // Swap in the new geometry and the decoding its vertices were written
+    // with, which instances carry
+    geometry.swap(replacement);
+    replacement.reset();
+    std::vector<compactvertex>().swap(replacementPacked);
+    vertexBufferSize = nextVertexSize;
+    positionOffset = nextCompact ? geometry->boundsMin() : glm::vec3(0.0f);
+    positionScale = nextCompact ? geometry->boundsMax() - geometry->boundsMin() :
+        glm::vec3(1.0f);
+    uploadMaterials();
+    filepath = reloadPath;
+    reloadState = idle;
+    std::cout << filepath << ": reloaded, " << (vertexBufferSize + nextIndexSize)/1024
+        << " KB of pooled GPU buffers\n";
+    return used;
+}
+
+bool asset::isReloading() const
+{
+    return reloadState != idle;
+}
+
+std::string asset::path() const
+{
+    return filepath;
+}
+
+std::string asset::materialPath() const
+{
+    return geometry->mtlPath();
+}
+
+uint64_t asset::contentHash() const
+{
+    return geometry->sourceHash();
+}
+
+glm::vec3 asset::boundsCenter() const
+{
+    return 0.5f*(geometry->boundsMin() + geometry->boundsMax());
+}
+
+float asset::boundsRadius() const
+{
+    return 0.5f*glm::length(geometry->boundsMax() - geometry->boundsMin());
+}
+
+size_t asset::lodLevel(float errorScale) const
+{
+    size_t level = 0;
+    while(level + 1 < geometry->lodCount() &&
+            geometry->lod(level + 1).error*errorScale <= 1.0f)
+    {
+        level++;
+    }
+    return level;
+}
+
+void asset::initRanges()
+{
+    // Quantize vertices against the mesh bounds for the compact layout,
+    // unless a baked mesh already holds them quantized
+    bool compact = geometry->isCompact() ||
+        (compactVertices && geometry->vertexCount() > 0);
+    if(compact)
+    {
+        if(!geometry->isCompact())
+        {
+            packvertices(geometry->vertices(), geometry->vertexCount(),
+                    geometry->boundsMin(), geometry->boundsMax(), packed);
+        }
+        positionOffset = geometry->boundsMin();
+        positionScale = geometry->boundsMax() - geometry->boundsMin();
+        vertexBufferSize = geometry->vertexCount() * sizeof(compactvertex);
+    }
+    else
+    {
+        vertexBufferSize = geometry->vertexCount() * sizeof(vertex);
+    }
+
+    // Allocate ranges of the pool for this layout, filled by upload()
+    pool = &geometrypool::forLayout(compact, geometry->indexSize());
+    firstVertex = pool->vertices().allocate(geometry->vertexCount());
+    firstIndex = pool->indices().allocate(geometry->indexCount());
+    uploadMaterials();
+}
+
+void asset::releaseRanges()
+{
+    pool->vertices().release(firstVertex, geometry->vertexCount());
+    pool->indices().release(firstIndex, geometry->indexCount());
+    geometrypool::materials().release(firstMaterial, geometry->materialCount());
+}
+
+void asset::uploadMaterials()
+{
+    // The material table is small, so it is written at once
+    bufferarena &materials = geometrypool::materials();
+    firstMaterial = materials.allocate(geometry->materialCount());
+    materials.write(firstMaterial*sizeof(material), geometry->materials(),
+            geometry->materialCount()*sizeof(material));
+}
+
+drawstats asset::queueDraw(renderqueue &queue,
+        const std::vector<meshinstance> &instances, glm::mat4 viewMatrix, glm::mat4 projectionMatrix, float lodScale)
+{
+    // Sort the instances inside the view frustum by level of detail
+    glm::vec4 planes[6];
+    frustumPlanes(projectionMatrix*viewMatrix, planes);
+    glm::vec3 eye(glm::inverse(viewMatrix)[3]);
+    drawstats stats;
+    sortInstances(instances, planes, eye, 0, lodScale, stats);
+
+    for(size_t level = 0; level < levelInstances.size(); level++)
+    {
+        const std::vector<meshinstance> &group = levelInstances[level];
+        if(group.empty())
+        {
+            continue;
+        }
+
+        // Cull the meshlets of a lone instance in model space against the
+        // view frustum and the camera position; instances drawn together
+        // draw the whole level
+        meshlod lod = geometry->lod(level);
+        if(group.size() == 1)
+        {
+            glm::mat4 modelView = viewMatrix*group[0].model;
+            glm::vec4 modelPlanes[6];
+            frustumPlanes(projectionMatrix*modelView, modelPlanes);
+            cullMeshlets(lod, modelPlanes, glm::vec3(glm::inverse(modelView)[3]), 0,
+                    stats);
+        }
+        else
+        {
+            levelRuns(lod, group.size(), stats);
+        }
+
+        // Queue the instances once, and the runs of each material range
+        // of the level with a record carrying that range's material, at
+        // the depth of the nearest instance
+        float depth = nearestDistance(group, eye);
+        GLuint firstInstance = queueInstances(group);
+        for(size_t r = 0; r < lod.rangeCount; r++)
+        {
+            if(rangeRuns[r] == rangeRuns[r + 1])
+            {
+                continue;
+            }
+            indexrange range = geometry->range(lod.firstRange + r);
+            GLuint materialIndex = firstMaterial + range.group;
+            queueRuns(queue, rangeRuns[r], rangeRuns[r + 1],
+                    queueRecord(firstInstance, materialIndex), group.size(),
+                    materialIndex, depth, stats);
+        }
+    }
+    return stats;
+}
+
+drawstats asset::queueShadowmap(renderqueue &queue,
+        const std::vector<meshinstance> &instances, light l, glm::vec3 shadowmapSize, float lodScale)
+{
+    // Nothing beyond the shadowmap depth is rasterized, so instances and
+    // meshlets out of the light's reach are culled along with meshlets
+    // facing away from it
+    drawstats stats;
+    sortInstances(instances, 0, l.position, shadowmapSize.z, lodScale, stats);
+
+    for(size_t level = 0; level < levelInstances.size(); level++)
+    {
+        const std::vector<meshinstance> &group = levelInstances[level];
+        if(group.empty())
+        {
+            continue;
+        }
+
+        // Materials do not matter for depth, so the whole level is one
+        // command for several instances, and a lone instance draws its
+        // visible runs of every range
+        meshlod lod = geometry->lod(level);
+        float depth = nearestDistance(group, l.position);
+        if(group.size() > 1)
+        {
+            levelRuns(lod, group.size(), stats);
+            drawcommand command = {GLuint(lod.indexCount), GLuint(group.size()),
+                GLuint(firstIndex + lod.indexOffset), GLint(firstVertex),
+                queueRecord(queueInstances(group), 0)};
+            queue.addDraw(*pool, 0, depth, command);
+            stats.commands++;
+            continue;
+        }
+        const meshinstance &instance = group[0];
+        glm::vec3 lightmpos = glm::transpose(instance.normal)*
+            (l.position - glm::vec3(instance.model[3]));
+        cullMeshlets(lod, 0, lightmpos, shadowmapSize.z, stats);
+        if(!runCounts.empty())
+        {
+            queueRuns(queue, 0, runCounts.size(),
+                    queueRecord(queueInstances(group), 0), 1, 0, depth, stats);
+        }
+    }
+    return stats;
+}
+
+void asset::sortInstances(const std::vector<meshinstance> &instances,
+        const glm::vec4 *planes, glm::vec3 viewpoint, float maxDistance,
+        float lodScale, drawstats &stats)
+{
+    levelInstances.resize(geometry->lodCount());
+    for(size_t level = 0; level < levelInstances.size(); level++)
+    {
+        levelInstances[level].clear();
+    }
+
+    glm::vec3 center = boundsCenter();
+    float radius = boundsRadius();
+    for(size_t i = 0; i < instances.size(); i++)
+    {
+        // Bounds are tested in world space against the frustum, and in
+        // model space against the shadowmap depth, which is measured there
+        const meshinstance &instance = instances[i];
+        glm::vec3 worldCenter(instance.model*glm::vec4(center, 1));
+        bool outside = planes &&
+            !sphereInFrustum(planes, worldCenter, maximumScale(instance.model)*radius);
+        if(!outside && maxDistance > 0)
+        {
+            glm::vec3 modelViewpoint = glm::transpose(instance.normal)*
+                (viewpoint - glm::vec3(instance.model[3]));
+            outside = glm::length(center - modelViewpoint) - radius > maxDistance;
+        }
+        if(outside)
+        {
+            stats.culledInstances++;
+            continue;
+        }
+        stats.instances++;
+        levelInstances[instanceLevel(instance, viewpoint, lodScale)].push_back(instance);
+    }
+}
+
+size_t asset::instanceLevel(const meshinstance &instance, glm::vec3 viewpoint,
+        float lodScale) const
+{
+    // Project errors from the nearest point of the bounding sphere, using
+    // the largest scale of the model matrix
+    float scale = maximumScale(instance.model);
+    glm::vec3 center(instance.model*glm::vec4(boundsCenter(), 1));
+    float distance = glm::length(center - viewpoint) - scale*boundsRadius();
+    if(distance <= 0)
+    {
+        return 0;
+    }
+    return lodLevel(scale*lodScale/distance);
+}
+
+float asset::nearestDistance(const std::vector<meshinstance> &instances,
+        glm::vec3 viewpoint) const
+{
+    float nearest = -1;
+    for(size_t i = 0; i < instances.size(); i++)
+    {
+        glm::vec3 center(instances[i].model*glm::vec4(boundsCenter(), 1));
+        float distance = glm::length(center - viewpoint) -
+            maximumScale(instances[i].model)*boundsRadius();
+        if(nearest < 0 || distance < nearest)
+        {
+            nearest = distance;
+        }
+    }
+    return std::max(nearest, 0.0f);
+}
+
+GLuint asset::queueInstances(const std::vector<meshinstance> &instances)
+{
+    return pool->addInstances(&instances[0], instances.size());
+}
+
+GLuint asset::queueRecord(GLuint firstInstance, GLint materialIndex)
+{
+    drawrecord record = {positionOffset, materialIndex, positionScale,
+        GLint(firstInstance)};
+    return pool->addRecord(record);
+}
+
+void asset::queueRuns(renderqueue &queue, size_t first, size_t last,
+        GLuint baseInstance, size_t count, GLuint materialIndex, float depth,
+        drawstats &stats)
+{
+    // Indices are relative to the asset's first vertex in the pool
+    for(size_t i = first; i < last; i++)
+    {
+        drawcommand command = {runCounts[i], GLuint(count),
+            GLuint(firstIndex + runFirsts[i]), GLint(firstVertex), baseInstance};
+        queue.addDraw(*pool, materialIndex, depth, command);
+        stats.commands++;
+    }
+}
+
+void asset::levelRuns(const meshlod &lod, size_t count, drawstats &stats)
+{
+    runCounts.clear();
+    runFirsts.clear();
+    rangeRuns.assign(1, 0);
+    for(size_t r = 0; r < lod.rangeCount; r++)
+    {
+        indexrange range = geometry->range(lod.firstRange + r);
+        runCounts.push_back(range.indexCount);
+        runFirsts.push_back(range.indexOffset);
+        rangeRuns.push_back(runCounts.size());
+        stats.meshlets += count*geometry->rangeMeshlets(lod.firstRange + r).second;
+    }
+    stats.triangles += count*lod.indexCount/3;
+}
+
+void asset::cullMeshlets(const meshlod &lod, const glm::vec4 *planes,
+        glm::vec3 viewpoint, float maxDistance, drawstats &stats)
+{
+    runCounts.clear();
+    runFirsts.clear();
+    rangeRuns.assign(1, 0);
+
+    // Reject the whole level at once when its bounding sphere is outside
+    glm::vec3 center = boundsCenter();
+    float radius = boundsRadius();
+    bool outside = (planes && !sphereInFrustum(planes, center, radius)) ||
+        (maxDistance > 0 && glm::length(center - viewpoint) - radius > maxDistance);
+
+    const meshlet *meshlets = geometry->meshlets();
+    for(size_t r = 0; r < lod.rangeCount; r++)
+    {
+        std::pair<size_t, size_t> clusters = geometry->rangeMeshlets(lod.firstRange + r);
+        size_t runEnd = size_t(-1);
+        for(size_t i = clusters.first; i < clusters.first + clusters.second; i++)
+        {
+            const meshlet &m = meshlets[i];
+            glm::vec3 offset = m.center - viewpoint;
+            float distance = glm::length(offset);
+            if(outside ||
+                    glm::dot(offset, m.coneAxis) >= m.coneCutoff*distance + m.radius ||
+                    (maxDistance > 0 && distance - m.radius > maxDistance) ||
+                    (planes && !sphereInFrustum(planes, m.center, m.radius)))
+            {
+                stats.culledMeshlets++;
+                continue;
+            }
+
+            // Meshlets adjacent in the index buffer extend the current run
+            stats.meshlets++;
+            stats.triangles += m.indexCount/3;
+            if(m.indexOffset == runEnd)
+            {
+                runCounts.back() += m.indexCount;
+            }
+            else
+            {
+                runCounts.push_back(m.indexCount);
+                runFirsts.push_back(m.indexOffset);
+            }
+            runEnd = m.indexOffset + m.indexCount;
+        }
+        rangeRuns.push_back(runCounts.size());
+    }
+}
+
+bool asset::loadMesh(const std::string &source, meshcache &target)
+{
+    timer clock;
+
+    // Baked meshes are used as they are, even without their sources
+    if(meshcache::isBakedPath(source))
+    {
+        if(!target.openBaked(source))
+        {
+            std::cout << source << ": not a valid baked mesh!\n";
+            return false;
+        }
+        std::cout << source << ": loaded baked mesh in "
+            << clock.milliseconds() << " ms\n";
+        return true;
+    }
+
+    // Warm start: map the binary cache written by an earlier run
+    if(target.open(source))
+    {
+        std::cout << source << ": loaded from cache in "
+            << clock.milliseconds() << " ms (warm)\n";
+        return true;
+    }
+
+    if(!buildmesh(source, meshcache::cachePath(source), false, false, target))
+    {
+        return false;
+    }
+    std::cout << source << ": parsed and cached in "
+        << clock.milliseconds() << " ms (cold)\n";
+    return true;
+}
@@ -0,0 +1,238 @@
+#ifndef __ASSET_HPP__
+#define __ASSET_HPP__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <stdint.h>
+
+#include "includes/glm_include.hpp"
+#include "includes/gl_include.h"
+#include "engine/light.hpp"
+#include "engine/meshcache.hpp"
+#include "engine/vertex.hpp"
+#include "engine/material.hpp"
+#include "engine/parallel.hpp"
+#include "engine/geometrypool.hpp"
+#include "engine/renderqueue.hpp"
+
+/* Geometry and materials of one OBJ file, shared by every mesh instance
+ * drawing it, and their ranges of the geometry pools.  Loading may run on
+ * a worker thread; pool ranges are written on the GL thread, possibly
+ * over several frames.
+ * A resident asset can be reloaded from changed files the same way while
+ * its current geometry keeps drawing.
+ */
+namespace engine
+{
+    /* Work recorded for draw calls: triangles drawn, instances and
+     * meshlets drawn or rejected by culling, and draw commands queued
+     */
+    struct drawstats
+    {
+        size_t triangles, meshlets, culledMeshlets, commands;
+        size_t instances, culledInstances;
+
+        drawstats();
+        drawstats &operator+=(const drawstats &s);
+    };
+
+    class asset
+    {
+        public:
+            asset(std::string filepath);
+            ~asset();
+
+            /* load geometry and material, from the mesh cache when valid;
+             * safe to call from any thread, and only loads once
+             */
+            bool load();
+
+            /* allocate pool ranges, uploading all vertex data */
+            void upload();
+
+            /* continue uploading a loaded asset, transferring at most
+             * byteBudget bytes of vertex data; returns the bytes used
+             */
+            size_t upload(size_t byteBudget);
+
+            bool isLoaded() const;
+            bool isResident() const;
+            bool hasFailed() const;
+
+            /* start rebuilding the geometry of a resident asset from its
+             * changed files on one of workers, keeping the current
+             * geometry if that fails.  source is the OBJ or baked mesh to
+             * rebuild from: the asset's path, or another file that shared
+             * its content, which becomes its path once swapped in.
+             * Returns false without doing anything while an earlier
+             * reload is not finished; the asset must stay alive until
+             * isReloading turns false.
+             */
+            bool reload(workerpool &workers, std::string source);
+
+            /* swap in geometry rebuilt by reload, transferring at most
+             * byteBudget bytes of vertex data; returns the bytes used.
+             * Ranges whose size is unchanged are overwritten at once,
+             * others are streamed into new ranges over several calls and
+             * swapped in when complete, so instances never draw a mix of
+             * old and new data.
+             */
+            size_t applyReload(size_t byteBudget);
+
+            /* whether a reload is building or waiting to be applied */
+            bool isReloading() const;
+
+            std::string path() const;
+
+            /* material library the geometry was built from */
+            std::string materialPath() const;
+
+            /* content hash of the source OBJ file */
+            uint64_t contentHash() const;
+
+            /* bounding sphere of the geometry in model space */
+            glm::vec3 boundsCenter() const;
+            float boundsRadius() const;
+
+            /* coarsest level of detail whose error stays within one unit
+             * once scaled by errorScale, e.g. pixels per model unit
+             */
+            size_t lodLevel(float errorScale) const;
+
+            /* record draws of instances in the current pass of queue,
+             * skipping those outside the view frustum.  Each is drawn at
+             * the coarsest level of detail whose error stays within one
+             * unit once scaled by lodScale over its distance.  Instances
+             * at the same level share instanced commands, while one alone
+             * at its level has its meshlets culled instead.
+             */
+            drawstats queueDraw(renderqueue &queue,
+                    const std::vector<meshinstance> &instances,
+                    glm::mat4 viewMatrix, glm::mat4 projectionMatrix,
+                    float lodScale);
+
+            /* record draws of instances into the shadowmap of one light
+             * source in the current pass of queue, skipping those beyond
+             * the shadowmap depth, at levels of detail chosen and shared
+             * as by queueDraw
+             */
+            drawstats queueShadowmap(renderqueue &queue,
+                    const std::vector<meshinstance> &instances,
+                    light l, glm::vec3 shadowmapSize, float lodScale);
+
+        private:
+            std::string filepath;
+
+            /* mesh data, and its rebuilt replacement during a reload */
+            std::unique_ptr<meshcache> geometry;
+            std::unique_ptr<meshcache> replacement;
+
+            /* the pool matching the vertex layout and index size, and the
+             * first vertex, index and material of the asset's ranges in
+             * it; compact positions decode as
+             * positionOffset + positionScale*position
+             */
+            geometrypool *pool;
+            size_t firstVertex, firstIndex, firstMaterial;
+            std::vector<compactvertex> packed;
+            size_t vertexBufferSize;
+            glm::vec3 positionOffset, positionScale;
+
+            /* loading progress, written by the loading thread */
+            enum loadstate { pending, loaded, resident, failed };
+            std::atomic<int> state;
+            std::once_flag loadOnce;
+            bool rangesAllocated;
+            size_t vertexBytesUploaded, indexBytesUploaded;
+
+            /* reload progress, the file rebuilt from, and the ranges a
+             * replacement of another size or layout is streamed into
+             */
+            enum reloadstate { idle, building, built };
+            std::atomic<int> reloadState;
+            std::string reloadPath;
+            std::vector<compactvertex> replacementPacked;
+            bool reloadRangesAllocated;
+            geometrypool *reloadPool;
+            size_t reloadFirstVertex, reloadFirstIndex;
+            size_t reloadVertexBytesUploaded, reloadIndexBytesUploaded;
+
+            /* visible instances at each level of detail, as sorted by
+             * sortInstances
+             */
+            std::vector<std::vector<meshinstance> > levelInstances;
+
+            /* runs of adjacent visible meshlets found by cullMeshlets, as
+             * index counts and first indices; the runs of range r of the
+             * level are those from rangeRuns[r] up to rangeRuns[r + 1]
+             */
+            std::vector<GLuint> runCounts;
+            std::vector<GLuint> runFirsts;
+            std::vector<size_t> rangeRuns;
+
+            /* loading helpers */
+            bool loadMesh(const std::string &source, meshcache &target);
+            void rebuild();
+            void initRanges();
+            void releaseRanges();
+            void uploadMaterials();
+
+            /* drawing helpers: sort the instances that may be visible
+             * from viewpoint, inside the given world space frustum planes
+             * if any, and within maxDistance units if positive, into
+             * levelInstances
+             */
+            void sortInstances(const std::vector<meshinstance> &instances,
+                    const glm::vec4 *planes, glm::vec3 viewpoint,
+                    float maxDistance, float lodScale, drawstats &stats);
+
+            /* level of detail of an instance seen from viewpoint */
+            size_t instanceLevel(const meshinstance &instance,
+                    glm::vec3 viewpoint, float lodScale) const;
+
+            /* distance from viewpoint to the nearest bounding sphere of
+             * instances, or zero if inside one
+             */
+            float nearestDistance(const std::vector<meshinstance> &instances,
+                    glm::vec3 viewpoint) const;
+
+            /* add instances to the pool, returning the first */
+            GLuint queueInstances(const std::vector<meshinstance> &instances);
+
+            /* add a record of the asset's position decoding and a material
+             * for instances from firstInstance, returning the base
+             * instance of commands drawing them
+             */
+            GLuint queueRecord(GLuint firstInstance, GLint materialIndex);
+
+            /* record the runs of ranges from first up to last for count
+             * instances of the record at baseInstance, keyed by material
+             * and depth
+             */
+            void queueRuns(renderqueue &queue, size_t first, size_t last,
+                    GLuint baseInstance, size_t count, GLuint materialIndex,
+                    float depth, drawstats &stats);
+
+            /* runs of every range of a level, drawn whole for count
+             * instances
+             */
+            void levelRuns(const meshlod &lod, size_t count, drawstats &stats);
+
+            /* collect the meshlets of a level that may be visible from
+             * viewpoint, in model space, inside the given frustum planes
+             * if any, and within maxDistance model space units if
+             * positive, the space shadowmap depth is measured in
+             */
+            void cullMeshlets(const meshlod &lod, const glm::vec4 *planes,
+                    glm::vec3 viewpoint, float maxDistance, drawstats &stats);
+
+            /* assets are shared, never copied */
+            asset(const asset& a);
+            asset& operator=(const asset& a);
+    };
+}
+
+#endif  // ifndef __ASSET_HPP__
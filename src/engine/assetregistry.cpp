@@ -0,0 +1,265 @@
+#include "engine/assetregistry.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+using namespace engine;
+
+namespace
+{
+    /* absolute path with symlinks resolved, or the path itself if the
+     * file does not exist
+     */
+    std::string canonicalPath(std::string filepath)
+    {
+        char resolved[PATH_MAX];
+        if(realpath(filepath.c_str(), resolved))
+        {
+            return resolved;
+        }
+        return filepath;
+    }
+}
+
+// Background threads parsing assets; each parse also splits large files
+// across parserThreads
+#define LOADER_THREADS 2
+
+assetregistry::assetregistry() :
+    byPath(),
+    byHash(),
+    pending(),
+    watcher(),
+    watchers(),
+    reloading(),
+    stale(),
+    loader(LOADER_THREADS)
+{}
+
+assetregistry &assetregistry::instance()
+{
+    static assetregistry registry;
+    return registry;
+}
+
+std::shared_ptr<asset> assetregistry::load(std::string filepath)
+{
+    std::string key = canonicalPath(filepath);
+    std::shared_ptr<asset> loaded = byPath[key].lock();
+    if(loaded)
+    {
+        // The asset may still be loading in the background; finish it here
+        if(!loaded->load())
+        {
+            exit(1);
+        }
+        loaded->upload();
+        return loaded;
+    }
+
+    loaded = std::make_shared<asset>(filepath);
+    if(!loaded->load())
+    {
+        exit(1);
+    }
+
+    // A different path may hold identical content that is already loaded;
+    // changes to this one reload it too
+    std::shared_ptr<asset> existing = byHash[loaded->contentHash()].lock();
+    if(existing)
+    {
+        std::cout << filepath << ": same content as " << existing->path()
+            << ", sharing it\n";
+        byPath[key] = existing;
+        existing->load();
+        existing->upload();
+        watchPath(filepath, existing);
+        return existing;
+    }
+
+    loaded->upload();
+    byPath[key] = loaded;
+    byHash[loaded->contentHash()] = loaded;
+    watchSources(loaded);
+    return loaded;
+}
+
+std::shared_ptr<asset> assetregistry::loadAsync(std::string filepath)
+{
+    std::string key = canonicalPath(filepath);
+    std::shared_ptr<asset> loaded = byPath[key].lock();
+    if(loaded)
+    {
+        return loaded;
+    }
+
+    loaded = std::make_shared<asset>(filepath);
+    byPath[key] = loaded;
+    pending.push_back(loaded);
+    loader.submit([loaded]() {
+        loaded->load();
+    });
+    return loaded;
+}
+
+void assetregistry::uploadPending(size_t byteBudget)
+{
+    std::vector<std::shared_ptr<asset> > stillPending;
+    for(size_t i = 0; i < pending.size(); i++)
+    {
+        std::shared_ptr<asset> a = pending[i];
+        if(a->hasFailed())
+        {
+            continue;
+        }
+
+        if(a->isLoaded() && byteBudget > 0)
+        {
+            byteBudget -= a->upload(byteBudget);
+        }
+
+        if(a->isResident())
+        {
+            if(byHash[a->contentHash()].expired())
+            {
+                byHash[a->contentHash()] = a;
+            }
+            watchSources(a);
+        }
+        else
+        {
+            stillPending.push_back(a);
+        }
+    }
+    pending.swap(stillPending);
+}
+
+void assetregistry::reloadChanged(size_t byteBudget)
+{
+    std::vector<std::string> changed;
+    watcher.poll(changed);
+    for(size_t i = 0; i < changed.size(); i++)
+    {
+        std::multimap<std::string, std::weak_ptr<asset> >::iterator it =
+            watchers.lower_bound(changed[i]);
+        while(it != watchers.end() && it->first == changed[i])
+        {
+            if(it->second.expired())
+            {
+                watchers.erase(it++);
+                continue;
+            }
+            // The OBJ and MTL of one asset may change together
+            std::shared_ptr<asset> a = it->second.lock();
+            bool queued = false;
+            for(size_t j = 0; j < stale.size() && !queued; j++)
+            {
+                queued = stale[j].first.lock() == a;
+            }
+            if(!queued)
+            {
+                // A file sharing the asset's content is rebuilt from
+                // itself, since the asset's own files did not change
+                bool shared = changed[i] != a->path() && changed[i] != a->materialPath();
+                std::cout << changed[i] << " changed, reloading\n";
+                stale.push_back(std::make_pair(std::weak_ptr<asset>(a),
+                            shared ? changed[i] : a->path()));
+            }
+            ++it;
+        }
+    }
+
+    // Start rebuilding each changed asset once; assets still loading or
+    // reloading are rebuilt once they are done
+    std::vector<std::pair<std::weak_ptr<asset>, std::string> > waiting;
+    for(size_t i = 0; i < stale.size(); i++)
+    {
+        std::shared_ptr<asset> a = stale[i].first.lock();
+        if(!a || a->hasFailed())
+        {
+            continue;
+        }
+        if(!a->reload(loader, stale[i].second))
+        {
+            waiting.push_back(stale[i]);
+            continue;
+        }
+        reloading.push_back(a);
+    }
+    stale.swap(waiting);
+
+    // Swap in rebuilt assets; their content hash changes with their
+    // files, and their path and material library may change too
+    std::vector<std::shared_ptr<asset> > stillReloading;
+    for(size_t i = 0; i < reloading.size(); i++)
+    {
+        std::shared_ptr<asset> a = reloading[i];
+        uint64_t previousHash = a->contentHash();
+        byteBudget -= std::min(byteBudget, a->applyReload(byteBudget));
+        if(a->isReloading())
+        {
+            stillReloading.push_back(a);
+            continue;
+        }
+        if(a->contentHash() != previousHash)
+        {
+            if(byHash[previousHash].lock() == a)
+            {
+                byHash.erase(previousHash);
+            }
+            if(byHash[a->contentHash()].expired())
+            {
+                byHash[a->contentHash()] = a;
+            }
+            watchSources(a);
+        }
+    }
+    reloading.swap(stillReloading);
+}
+
+void assetregistry::watchSources(const std::shared_ptr<asset> &a)
+{
+    // Baked meshes hold their materials, so only the mesh file matters
+    std::vector<std::string> paths(1, a->path());
+    if(!meshcache::isBakedPath(a->path()))
+    {
+        paths.push_back(a->materialPath());
+    }
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        watchPath(paths[i], a);
+    }
+}
+
+void assetregistry::watchPath(const std::string &path, const std::shared_ptr<asset> &a)
+{
+    std::multimap<std::string, std::weak_ptr<asset> >::iterator it;
+    for(it = watchers.lower_bound(path); it != watchers.end() && it->first == path; ++it)
+    {
+        if(it->second.lock() == a)
+        {
+            return;
+        }
+    }
+    watchers.insert(std::make_pair(path, std::weak_ptr<asset>(a)));
+    watcher.watch(path);
+}
+
+size_t assetregistry::size()
+{
+    // Paths sharing an asset count it once
+    std::vector<asset*> alive;
+    std::map<std::string, std::weak_ptr<asset> >::iterator it;
+    for(it = byPath.begin(); it != byPath.end(); ++it)
+    {
+        std::shared_ptr<asset> a = it->second.lock();
+        if(a)
+        {
+            alive.push_back(a.get());
+        }
+    }
+    std::sort(alive.begin(), alive.end());
+    return std::unique(alive.begin(), alive.end()) - alive.begin();
+}
@@ -0,0 +1,85 @@
+#ifndef __ASSETREGISTRY_HPP__
+#define __ASSETREGISTRY_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+#include "engine/asset.hpp"
+#include "engine/parallel.hpp"
+#include "engine/filewatcher.hpp"
+
+/* Process-wide registry of loaded assets.  Assets are keyed by canonical
+ * path and by the content hash of their OBJ, so every mesh instance of
+ * the same geometry shares one parse and one GL upload.  The registry
+ * holds weak references; an asset is released with its last instance.
+ * The files assets are loaded from are watched, every path sharing an
+ * asset among them, and an asset whose files change is reloaded in place
+ * for all its instances from the file that changed.  All methods must be
+ * called from the GL thread.
+ */
+namespace engine
+{
+    class assetregistry
+    {
+        public:
+            static assetregistry &instance();
+
+            /* find or load the asset for an OBJ file, uploaded for drawing */
+            std::shared_ptr<asset> load(std::string filepath);
+
+            /* find or start loading the asset for an OBJ file on a worker
+             * thread, returning its handle immediately.  The asset becomes
+             * resident through later calls to uploadPending.
+             */
+            std::shared_ptr<asset> loadAsync(std::string filepath);
+
+            /* upload assets finished by workers, transferring at most
+             * byteBudget bytes of vertex data
+             */
+            void uploadPending(size_t byteBudget);
+
+            /* start reloading assets whose OBJ, MTL or baked mesh files
+             * changed on worker threads, and swap in those rebuilt,
+             * transferring at most byteBudget bytes of vertex data
+             */
+            void reloadChanged(size_t byteBudget);
+
+            /* number of distinct assets currently alive */
+            size_t size();
+
+        private:
+            assetregistry();
+
+            std::map<std::string, std::weak_ptr<asset> > byPath;
+            std::map<uint64_t, std::weak_ptr<asset> > byHash;
+
+            /* assets loading in the background */
+            std::vector<std::shared_ptr<asset> > pending;
+
+            /* assets by the paths of files they are loaded from or share
+             * content with, assets being reloaded, and assets changed
+             * while not yet resident or still reloading, with the file
+             * to rebuild them from
+             */
+            filewatcher watcher;
+            std::multimap<std::string, std::weak_ptr<asset> > watchers;
+            std::vector<std::shared_ptr<asset> > reloading;
+            std::vector<std::pair<std::weak_ptr<asset>, std::string> > stale;
+
+            /* declared last, so running jobs finish before any asset they
+             * load is released
+             */
+            workerpool loader;
+
+            /* watch the files a resident asset is loaded from */
+            void watchSources(const std::shared_ptr<asset> &a);
+
+            /* watch a file for changes reloading a */
+            void watchPath(const std::string &path, const std::shared_ptr<asset> &a);
+    };
+}
+
+#endif  // ifndef __ASSETREGISTRY_HPP__
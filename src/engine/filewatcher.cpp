@@ -0,0 +1,179 @@
+#include "engine/filewatcher.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <climits>
+#endif
+
+using namespace engine;
+
+const double filewatcher::pollInterval = 0.5;
+
+namespace
+{
+    /* directory of a path and the file name within it */
+    void splitPath(std::string path, std::string &directory, std::string &name)
+    {
+        size_t slash = path.find_last_of('/');
+        if(slash == std::string::npos)
+        {
+            directory = ".";
+            name = path;
+        }
+        else
+        {
+            directory = slash == 0 ? "/" : path.substr(0, slash);
+            name = path.substr(slash + 1);
+        }
+    }
+}
+
+filewatcher::filewatcher() :
+    files(),
+    sincePoll(),
+    notifier(-1),
+    directories(),
+    locations()
+{
+#ifdef __linux__
+    notifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+filewatcher::~filewatcher()
+{
+    if(notifier >= 0)
+    {
+        close(notifier);
+    }
+}
+
+void filewatcher::watch(std::string path)
+{
+    if(files.count(path))
+    {
+        return;
+    }
+    struct stat st;
+    filestate state = {0, 0, true};
+    if(stat(path.c_str(), &st) == 0)
+    {
+        state.mtime = st.st_mtime;
+        state.size = st.st_size;
+    }
+
+#ifdef __linux__
+    if(notifier >= 0)
+    {
+        // Files are often replaced rather than rewritten, so their
+        // directories are watched for files written or moved in
+        std::string directory, name;
+        splitPath(path, directory, name);
+        int descriptor = inotify_add_watch(notifier, directory.c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(descriptor >= 0)
+        {
+            directories[descriptor] = directory;
+            locations[directory + "/" + name] = path;
+            state.polled = false;
+        }
+    }
+#endif
+    files[path] = state;
+}
+
+void filewatcher::poll(std::vector<std::string> &changed)
+{
+    if(notifier >= 0)
+    {
+        readEvents(changed);
+    }
+    if(sincePoll.seconds() >= pollInterval)
+    {
+        pollTimes(changed);
+        sincePoll.reset();
+    }
+}
+
+void filewatcher::pollTimes(std::vector<std::string> &changed)
+{
+    std::map<std::string, filestate>::iterator it;
+    for(it = files.begin(); it != files.end(); ++it)
+    {
+        struct stat st;
+        if(!it->second.polled || stat(it->first.c_str(), &st) != 0)
+        {
+            continue;
+        }
+        if(st.st_mtime != it->second.mtime || uint64_t(st.st_size) != it->second.size)
+        {
+            it->second.mtime = st.st_mtime;
+            it->second.size = st.st_size;
+            changed.push_back(it->first);
+        }
+    }
+}
+
+void filewatcher::readEvents(std::vector<std::string> &changed)
+{
+#ifdef __linux__
+    char buffer[16*(sizeof(inotify_event) + NAME_MAX + 1)]
+        __attribute__((aligned(__alignof__(inotify_event))));
+    size_t first = changed.size();
+    for(;;)
+    {
+        ssize_t length = read(notifier, buffer, sizeof(buffer));
+        if(length <= 0)
+        {
+            break;
+        }
+        for(char *p = buffer; p < buffer + length;
+                p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len)
+        {
+            const inotify_event *event = reinterpret_cast<const inotify_event*>(p);
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were lost, so anything may have changed
+                std::map<std::string, filestate>::iterator it;
+                for(it = files.begin(); it != files.end(); ++it)
+                {
+                    changed.push_back(it->first);
+                }
+                continue;
+            }
+            if(event->len == 0 || !directories.count(event->wd))
+            {
+                continue;
+            }
+            std::map<std::string, std::string>::iterator location =
+                locations.find(directories[event->wd] + "/" + event->name);
+            if(location != locations.end())
+            {
+                changed.push_back(location->second);
+            }
+        }
+    }
+
+    // A file saved several times since the last call is reported once
+    std::vector<std::string> unique;
+    for(size_t i = first; i < changed.size(); i++)
+    {
+        bool seen = false;
+        for(size_t j = 0; j < unique.size() && !seen; j++)
+        {
+            seen = unique[j] == changed[i];
+        }
+        if(!seen)
+        {
+            unique.push_back(changed[i]);
+        }
+    }
+    changed.resize(first);
+    changed.insert(changed.end(), unique.begin(), unique.end());
+#else
+    (void)changed;
+#endif
+}
@@ -0,0 +1,65 @@
+#ifndef __FILEWATCHER_HPP__
+#define __FILEWATCHER_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "engine/timer.hpp"
+
+/* Notification of changes to a set of files.  On Linux, the directories
+ * of watched files are watched with inotify, so files replaced by rename
+ * as editors save them are reported too.  Elsewhere, or if inotify is
+ * unavailable for a file, its modification time and size are polled
+ * instead, at most every pollInterval seconds.
+ */
+namespace engine
+{
+    class filewatcher
+    {
+        public:
+            static const double pollInterval;
+
+            filewatcher();
+            ~filewatcher();
+
+            /* start watching a file, which need not exist yet */
+            void watch(std::string path);
+
+            /* add the watched files changed since the last call to changed,
+             * by the paths they were watched under, without blocking
+             */
+            void poll(std::vector<std::string> &changed);
+
+        private:
+            /* watched paths, and their last seen modification time and
+             * size for those that are polled
+             */
+            struct filestate
+            {
+                int64_t mtime;
+                uint64_t size;
+                bool polled;
+            };
+            std::map<std::string, filestate> files;
+            timer sincePoll;
+
+            /* inotify descriptor, or -1 when polling, the directory of
+             * every watch descriptor, and the watched path of every
+             * directory and file name pair
+             */
+            int notifier;
+            std::map<int, std::string> directories;
+            std::map<std::string, std::string> locations;
+
+            void pollTimes(std::vector<std::string> &changed);
+            void readEvents(std::vector<std::string> &changed);
+
+            /* watchers are not copyable */
+            filewatcher(const filewatcher& w);
+            filewatcher& operator=(const filewatcher& w);
+    };
+}
+
+#endif  // ifndef __FILEWATCHER_HPP__
@@ -0,0 +1,383 @@
+#include "engine/geometrypool.hpp"
+#include "engine/vertex.hpp"
+#include "engine/material.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+// Bytes a new arena makes room for at first; 1 MB of materials stays
+// within the smallest texture buffer GL allows
+#define MIN_ARENA_BYTES (1 << 20)
+
+// Attribute locations of the mesh programs
+#define POSITION_ATTRIBUTE 0
+#define NORMAL_ATTRIBUTE 1
+#define OFFSET_ATTRIBUTE 2
+#define SCALE_ATTRIBUTE 3
+#define MATERIAL_ATTRIBUTE 4
+#define FIRST_INSTANCE_ATTRIBUTE 5
+
+// Texels of a streamed instance: the columns of its model matrix, then
+// those of its normal matrix; the mesh programs read them in this order
+#define INSTANCE_TEXELS 7
+
+// Records are read once per command: with a divisor above any instance
+// count, every instance of a command reads the record at its base
+// instance
+#define RECORD_DIVISOR (1u << 30)
+
+using namespace engine;
+
+namespace
+{
+    GLuint materialTexture = 0;
+    size_t materialGeneration = 0;
+    geometrypool *pools[2][2] = {{0, 0}, {0, 0}};
+}
+
+bufferarena::bufferarena(size_t elementSize) :
+    elementSize(elementSize),
+    capacity(0),
+    grows(0),
+    storage(),
+    freeRuns()
+{}
+
+size_t bufferarena::allocate(size_t count)
+{
+    count = std::max(count, size_t(1));
+    for(;;)
+    {
+        // First fit, leaving the rest of the run free
+        std::map<size_t, size_t>::iterator it;
+        for(it = freeRuns.begin(); it != freeRuns.end(); ++it)
+        {
+            if(it->second >= count)
+            {
+                size_t first = it->first, rest = it->second - count;
+                freeRuns.erase(it);
+                if(rest > 0)
+                {
+                    freeRuns[first + count] = rest;
+                }
+                return first;
+            }
+        }
+        grow(count);
+    }
+}
+
+void bufferarena::release(size_t first, size_t count)
+{
+    count = std::max(count, size_t(1));
+
+    // Merge with the free runs on either side
+    std::map<size_t, size_t>::iterator next = freeRuns.lower_bound(first);
+    if(next != freeRuns.end() && first + count == next->first)
+    {
+        count += next->second;
+        freeRuns.erase(next++);
+    }
+    if(next != freeRuns.begin())
+    {
+        std::map<size_t, size_t>::iterator previous = next;
+        --previous;
+        if(previous->first + previous->second == first)
+        {
+            previous->second += count;
+            return;
+        }
+    }
+    freeRuns[first] = count;
+}
+
+void bufferarena::write(size_t offset, const void *data, size_t size)
+{
+    if(size > 0)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+}
+
+GLuint bufferarena::buffer() const
+{
+    return storage.id();
+}
+
+size_t bufferarena::generation() const
+{
+    return grows;
+}
+
+void bufferarena::grow(size_t count)
+{
+    // At least double, so repeated allocations copy little in total
+    size_t grown = std::max(std::max(2*capacity, capacity + count),
+            size_t(MIN_ARENA_BYTES)/elementSize);
+    glbuffer larger;
+    larger.create();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, larger.id());
+    glBufferData(GL_COPY_WRITE_BUFFER, grown*elementSize, 0, GL_STATIC_DRAW);
+    if(storage.id())
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, storage.id());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                capacity*elementSize);
+    }
+    storage = std::move(larger);
+    release(capacity, grown - capacity);
+    capacity = grown;
+    grows++;
+}
+
+bool geometrypool::multiDrawIndirect = true;
+const GLint geometrypool::instanceUnit = 2;
+
+geometrypool::geometrypool(bool compact, size_t indexSize) :
+    compact(compact),
+    elementSize(indexSize),
+    vertexArena(compact ? sizeof(compactvertex) : sizeof(vertex)),
+    indexArena(indexSize),
+    vertexArray(),
+    boundVertices(0),
+    boundIndices(0),
+    instances(),
+    records(),
+    recordSlice(),
+    instanceTexture()
+{
+    vertexArray.create();
+    instanceTexture.create();
+}
+
+geometrypool::~geometrypool()
+{}
+
+geometrypool &geometrypool::forLayout(bool compact, size_t indexSize)
+{
+    geometrypool *&pool = pools[compact][indexSize == 4];
+    if(!pool)
+    {
+        // Indirect commands read base instances, which need GL 4.3
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if(major < 4 || (major == 4 && minor < 3))
+        {
+            multiDrawIndirect = false;
+        }
+        pool = new geometrypool(compact, indexSize);
+    }
+    return *pool;
+}
+
+std::vector<std::string> geometrypool::attributes()
+{
+    std::vector<std::string> names(FIRST_INSTANCE_ATTRIBUTE + 1);
+    names[POSITION_ATTRIBUTE] = "vertexPosition_modelspace";
+    names[NORMAL_ATTRIBUTE] = "vertexNormal";
+    names[OFFSET_ATTRIBUTE] = "positionOffset";
+    names[SCALE_ATTRIBUTE] = "positionScale";
+    names[MATERIAL_ATTRIBUTE] = "materialIndex";
+    names[FIRST_INSTANCE_ATTRIBUTE] = "firstInstance";
+    return names;
+}
+
+bufferarena &geometrypool::materials()
+{
+    static bufferarena *arena = new bufferarena(sizeof(material));
+    return *arena;
+}
+
+void geometrypool::bindMaterials(GLenum unit)
+{
+    if(!materialTexture)
+    {
+        glGenTextures(1, &materialTexture);
+    }
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+    if(materialGeneration != materials().generation())
+    {
+        materialGeneration = materials().generation();
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, materials().buffer());
+    }
+}
+
+void geometrypool::prepareAll(streamring &ring)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        if(pools[i/2][i % 2])
+        {
+            pools[i/2][i % 2]->prepare(ring);
+        }
+    }
+}
+
+bool geometrypool::isCompact() const
+{
+    return compact;
+}
+
+size_t geometrypool::indexSize() const
+{
+    return elementSize;
+}
+
+bufferarena &geometrypool::vertices()
+{
+    return vertexArena;
+}
+
+bufferarena &geometrypool::indices()
+{
+    return indexArena;
+}
+
+GLuint geometrypool::addInstances(const meshinstance *first, size_t count)
+{
+    GLuint firstInstance = instances.size()/INSTANCE_TEXELS;
+    for(size_t i = 0; i < count; i++)
+    {
+        for(int c = 0; c < 4; c++)
+        {
+            instances.push_back(first[i].model[c]);
+        }
+        for(int c = 0; c < 3; c++)
+        {
+            instances.push_back(glm::vec4(first[i].normal[c], 0));
+        }
+    }
+    return firstInstance;
+}
+
+GLuint geometrypool::addRecord(const drawrecord &record)
+{
+    records.push_back(record);
+    return records.size() - 1;
+}
+
+GLuint geometrypool::vertexArrayId() const
+{
+    return vertexArray.id();
+}
+
+void geometrypool::prepare(streamring &ring)
+{
+    if(records.empty())
+    {
+        return;
+    }
+
+    // Point the vertex array at the arenas again if they grew
+    if(boundVertices != vertexArena.generation() ||
+            boundIndices != indexArena.generation())
+    {
+        initVertexArray();
+    }
+
+    // All of the frame's instances are written into its region of the
+    // ring at once, however many commands draw them, and read through a
+    // buffer texture over the whole ring; records then point at their
+    // first texel
+    streamslice instanceSlice = ring.write(&instances[0],
+            instances.size()*sizeof(glm::vec4), sizeof(glm::vec4));
+    glActiveTexture(GL_TEXTURE0 + instanceUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture.id());
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceSlice.buffer);
+    GLint firstTexel = instanceSlice.offset/sizeof(glm::vec4);
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        records[i].firstInstance = firstTexel + INSTANCE_TEXELS*records[i].firstInstance;
+    }
+
+    recordSlice = ring.write(&records[0], records.size()*sizeof(drawrecord),
+            sizeof(glm::vec4));
+    glBindVertexArray(vertexArray.id());
+    setRecordAttributes(recordSlice.buffer, recordSlice.offset);
+    glBindVertexArray(0);
+    instances.clear();
+    records.clear();
+}
+
+size_t geometrypool::draw(const drawcommand *commands, size_t count, streamring &ring)
+{
+    glActiveTexture(GL_TEXTURE0 + instanceUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture.id());
+
+    GLenum indexType = elementSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if(multiDrawIndirect)
+    {
+        streamslice indirect = ring.write(commands, count*sizeof(drawcommand),
+                sizeof(GLuint));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect.buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                (const GLvoid*)indirect.offset, count, 0);
+        return 1;
+    }
+
+    // Without base instances, the record attributes are pointed at each
+    // command's record in turn
+    for(size_t i = 0; i < count; i++)
+    {
+        const drawcommand &c = commands[i];
+        setRecordAttributes(recordSlice.buffer,
+                recordSlice.offset + c.baseInstance*sizeof(drawrecord));
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, indexType,
+                (const GLvoid*)(size_t(c.firstIndex)*elementSize), c.instanceCount,
+                c.baseVertex);
+    }
+    return count;
+}
+
+void geometrypool::initVertexArray()
+{
+    // Vertex layouts and the index buffer are recorded in the vertex
+    // array, so each frame only points the record attributes at where
+    // its records were streamed
+    glBindVertexArray(vertexArray.id());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexArena.buffer());
+    glBindBuffer(GL_ARRAY_BUFFER, vertexArena.buffer());
+    glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+    glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+    if(compact)
+    {
+        glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                sizeof(compactvertex), (void*)offsetof(compactvertex, position));
+        glVertexAttribPointer(NORMAL_ATTRIBUTE, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                sizeof(compactvertex), (void*)offsetof(compactvertex, normal));
+    }
+    else
+    {
+        glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                (void*)offsetof(vertex, position));
+        glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                (void*)offsetof(vertex, normal));
+    }
+
+    for(int i = OFFSET_ATTRIBUTE; i <= FIRST_INSTANCE_ATTRIBUTE; i++)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, RECORD_DIVISOR);
+    }
+
+    boundVertices = vertexArena.generation();
+    boundIndices = indexArena.generation();
+}
+
+void geometrypool::setRecordAttributes(GLuint buffer, size_t base)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(OFFSET_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(drawrecord),
+            (void*)(base + offsetof(drawrecord, positionOffset)));
+    glVertexAttribPointer(SCALE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(drawrecord),
+            (void*)(base + offsetof(drawrecord, positionScale)));
+    glVertexAttribIPointer(MATERIAL_ATTRIBUTE, 1, GL_INT, sizeof(drawrecord),
+            (void*)(base + offsetof(drawrecord, materialIndex)));
+    glVertexAttribIPointer(FIRST_INSTANCE_ATTRIBUTE, 1, GL_INT, sizeof(drawrecord),
+            (void*)(base + offsetof(drawrecord, firstInstance)));
+}
@@ -0,0 +1,192 @@
+#ifndef __GEOMETRYPOOL_HPP__
+#define __GEOMETRYPOOL_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "includes/glm_include.hpp"
+#include "includes/gl_include.h"
+#include "engine/globject.hpp"
+#include "engine/streamring.hpp"
+
+/* Shared GL storage for the geometry of all assets.  Vertices and
+ * indices are sub-allocated from a few large buffers, one pair per
+ * vertex layout and index size, and materials from one texture buffer.
+ * Instances and the records of the commands drawing them are added to a
+ * pool while a frame is recorded, and its draw commands submitted with
+ * one glMultiDrawElementsIndirect per run where GL 4.3 is available, or
+ * one instanced draw per command otherwise.
+ * Pools live for the whole process and must be used from the GL thread.
+ */
+namespace engine
+{
+    /* An instance of a mesh: the model matrix and the normal matrix (the
+     * transposed inverse of its linear part)
+     */
+    struct meshinstance
+    {
+        glm::mat4 model;
+        glm::mat3 normal;
+    };
+
+    /* Per-command attributes of the mesh programs: the decoding of
+     * quantized positions, the material in the material texture buffer,
+     * and the first of the instances drawn, as addInstances returned it
+     * until streaming turns it into their first texel.  The commands of
+     * every material range of a group of instances share its instances
+     * and differ only in their record.
+     */
+    struct drawrecord
+    {
+        glm::vec3 positionOffset;
+        GLint materialIndex;
+        glm::vec3 positionScale;
+        GLint firstInstance;
+    };
+
+    /* One draw of pool geometry, in the layout glMultiDrawElementsIndirect
+     * reads: count indices from firstIndex, offset by baseVertex, for
+     * instanceCount instances of the record at baseInstance
+     */
+    struct drawcommand
+    {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    /* Fixed-size elements sub-allocated from one GL buffer, which grows
+     * by copying into a larger buffer when no free run is large enough
+     */
+    class bufferarena
+    {
+        public:
+            bufferarena(size_t elementSize);
+
+            /* first element of count free elements */
+            size_t allocate(size_t count);
+            void release(size_t first, size_t count);
+
+            /* copy size bytes of data to a byte offset in the buffer */
+            void write(size_t offset, const void *data, size_t size);
+
+            /* current buffer, replaced whenever the arena grows */
+            GLuint buffer() const;
+
+            /* number of times the arena grew; a deleted buffer's name may
+             * be reused, so users compare this to notice a new buffer
+             */
+            size_t generation() const;
+
+        private:
+            size_t elementSize, capacity, grows;
+            glbuffer storage;
+
+            /* free runs of elements, by first element */
+            std::map<size_t, size_t> freeRuns;
+
+            void grow(size_t count);
+
+            /* arenas own their buffer, so are not copyable */
+            bufferarena(const bufferarena& a);
+            bufferarena& operator=(const bufferarena& a);
+    };
+
+    class geometrypool
+    {
+        public:
+            /* the pool for one vertex layout and index size (2 or 4) */
+            static geometrypool &forLayout(bool compact, size_t indexSize);
+
+            /* names of the mesh program inputs, in order of the attribute
+             * locations the pools' vertex arrays use
+             */
+            static std::vector<std::string> attributes();
+
+            /* materials of all assets, as two RGBA32F texels of diffuse
+             * and ambient color each
+             */
+            static bufferarena &materials();
+
+            /* bind the material texture buffer to a texture unit */
+            static void bindMaterials(GLenum unit);
+
+            /* texture unit draw binds the streamed instances to, as a
+             * buffer texture the mesh programs read by record
+             */
+            static const GLint instanceUnit;
+
+            /* stream the instances and records added to every pool
+             * through ring and point the pools' vertex arrays and
+             * instance textures at them, starting the next frame
+             */
+            static void prepareAll(streamring &ring);
+
+            /* whether draws are submitted indirectly; may be turned off
+             * before the first pool is used, and is off without GL 4.3
+             */
+            static bool multiDrawIndirect;
+
+            bool isCompact() const;
+            size_t indexSize() const;
+
+            bufferarena &vertices();
+            bufferarena &indices();
+
+            /* append instances to draw this frame, returning the index of
+             * the first for the records of commands drawing them
+             */
+            GLuint addInstances(const meshinstance *first, size_t count);
+
+            /* append the record of commands drawing instances this frame,
+             * returning it as their base instance
+             */
+            GLuint addRecord(const drawrecord &record);
+
+            /* the vertex array to bind before draw */
+            GLuint vertexArrayId() const;
+
+            /* draw commands with the current program and the pool's
+             * vertex array bound, after prepareAll; returns the GL draw
+             * calls issued
+             */
+            size_t draw(const drawcommand *commands, size_t count, streamring &ring);
+
+        private:
+            geometrypool(bool compact, size_t indexSize);
+
+            bool compact;
+            size_t elementSize;
+            bufferarena vertexArena, indexArena;
+
+            /* the vertex array over the arenas and the streamed records,
+             * and the arena generations it was last pointed at
+             */
+            glvertexarray vertexArray;
+            size_t boundVertices, boundIndices;
+
+            /* instances added this frame as RGBA32F texels, records added
+             * this frame, where prepare streamed the records of the frame
+             * being drawn, and the buffer texture over its instances
+             */
+            std::vector<glm::vec4> instances;
+            std::vector<drawrecord> records;
+            streamslice recordSlice;
+            gltexture instanceTexture;
+
+            void prepare(streamring &ring);
+            void initVertexArray();
+            void setRecordAttributes(GLuint buffer, size_t offset);
+
+            /* pools are never destroyed, since assets release their
+             * geometry into them until exit, so they are not copyable
+             */
+            ~geometrypool();
+            geometrypool(const geometrypool& p);
+            geometrypool& operator=(const geometrypool& p);
+    };
+}
+
+#endif  // ifndef __GEOMETRYPOOL_HPP__
@@ -0,0 +1,109 @@
+#ifndef __GLOBJECT_HPP__
+#define __GLOBJECT_HPP__
+
+#include "includes/gl_include.h"
+
+/* Move-only owners of GL object names, deleting their object when they
+ * are destroyed or replaced.  Moving one hands its object over without
+ * touching GL, so classes holding them are cheap to move and cannot be
+ * copied by accident.  They must be used from the GL thread.
+ */
+namespace engine
+{
+    /* GL calls creating and deleting one kind of object */
+    struct bufferkind
+    {
+        static void create(GLuint *name) { glGenBuffers(1, name); }
+        static void destroy(const GLuint *name) { glDeleteBuffers(1, name); }
+    };
+
+    struct texturekind
+    {
+        static void create(GLuint *name) { glGenTextures(1, name); }
+        static void destroy(const GLuint *name) { glDeleteTextures(1, name); }
+    };
+
+    struct framebufferkind
+    {
+        static void create(GLuint *name) { glGenFramebuffers(1, name); }
+        static void destroy(const GLuint *name) { glDeleteFramebuffers(1, name); }
+    };
+
+    struct renderbufferkind
+    {
+        static void create(GLuint *name) { glGenRenderbuffers(1, name); }
+        static void destroy(const GLuint *name) { glDeleteRenderbuffers(1, name); }
+    };
+
+    struct vertexarraykind
+    {
+        static void create(GLuint *name) { glGenVertexArrays(1, name); }
+        static void destroy(const GLuint *name) { glDeleteVertexArrays(1, name); }
+    };
+
+    template<typename kind> class globject
+    {
+        public:
+            /* an empty owner, holding no object */
+            globject() : name(0) {}
+
+            globject(globject &&o) : name(o.name)
+            {
+                o.name = 0;
+            }
+
+            globject &operator=(globject &&o)
+            {
+                if(this != &o)
+                {
+                    reset();
+                    name = o.name;
+                    o.name = 0;
+                }
+                return *this;
+            }
+
+            ~globject()
+            {
+                reset();
+            }
+
+            /* delete any object held and create a new one */
+            void create()
+            {
+                reset();
+                kind::create(&name);
+            }
+
+            /* delete any object held */
+            void reset()
+            {
+                if(name)
+                {
+                    kind::destroy(&name);
+                    name = 0;
+                }
+            }
+
+            /* the object's name, or 0 when empty */
+            GLuint id() const
+            {
+                return name;
+            }
+
+        private:
+            GLuint name;
+
+            /* owners are unique, so are not copyable */
+            globject(const globject& o);
+            globject& operator=(const globject& o);
+    };
+
+    typedef globject<bufferkind> glbuffer;
+    typedef globject<texturekind> gltexture;
+    typedef globject<framebufferkind> glframebuffer;
+    typedef globject<renderbufferkind> glrenderbuffer;
+    typedef globject<vertexarraykind> glvertexarray;
+}
+
+#endif  // ifndef __GLOBJECT_HPP__
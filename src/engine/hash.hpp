@@ -0,0 +1,58 @@
+#ifndef __HASH_HPP__
+#define __HASH_HPP__
+
+#include <stdint.h>
+#include <cstring>
+#include <cstddef>
+
+/* Fast non-cryptographic hashing for cache validation
+ */
+namespace engine
+{
+    inline uint64_t rotateLeft(uint64_t x, int bits)
+    {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    inline uint64_t mixBits(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /* 64-bit hash of a byte range, consuming eight bytes per step */
+    inline uint64_t hashBytes(const void *data, size_t size,
+            uint64_t seed = 0x9e3779b97f4a7c15ULL)
+    {
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed ^ (size*0x87c37b91114253d5ULL);
+
+        while(size >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            word *= 0x87c37b91114253d5ULL;
+            word = rotateLeft(word, 31);
+            word *= 0x4cf5ad432745937fULL;
+            h ^= word;
+            h = rotateLeft(h, 27)*5 + 0x52dce729;
+            p += 8;
+            size -= 8;
+        }
+
+        uint64_t tail = 0;
+        for(size_t i = 0; i < size; i++)
+        {
+            tail |= uint64_t(p[i]) << (8*i);
+        }
+        h ^= tail*0x4cf5ad432745937fULL;
+
+        return mixBits(h);
+    }
+}
+
+#endif  // ifndef __HASH_HPP__
@@ -0,0 +1,104 @@
+#include "engine/mappedfile.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace engine;
+
+mappedfile::mappedfile() :
+    begin(0),
+    length(0),
+    opened(false)
+{}
+
+mappedfile::mappedfile(std::string filepath) :
+    begin(0),
+    length(0),
+    opened(false)
+{
+    open(filepath);
+}
+
+mappedfile::~mappedfile()
+{
+    close();
+}
+
+bool mappedfile::open(std::string filepath)
+{
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap rejects empty ranges, so an empty file is an open, empty mapping
+    length = info.st_size;
+    if(length > 0)
+    {
+        void *addr = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED)
+        {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        madvise(addr, length, MADV_SEQUENTIAL);
+        begin = static_cast<const char*>(addr);
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void mappedfile::close()
+{
+    if(begin)
+    {
+        munmap(const_cast<char*>(begin), length);
+    }
+    begin = 0;
+    length = 0;
+    opened = false;
+}
+
+void mappedfile::release(size_t offset, size_t size)
+{
+    // Only whole pages inside the range can be dropped
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t first = (offset + page - 1)/page*page;
+    size_t last = std::min(offset + size, length)/page*page;
+    if(begin && first < last)
+    {
+        madvise(const_cast<char*>(begin) + first, last - first, MADV_DONTNEED);
+    }
+}
+
+bool mappedfile::isOpen() const
+{
+    return opened;
+}
+
+const char *mappedfile::data() const
+{
+    return begin;
+}
+
+size_t mappedfile::size() const
+{
+    return length;
+}
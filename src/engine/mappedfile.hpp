@@ -0,0 +1,43 @@
+#ifndef __MAPPEDFILE_HPP__
+#define __MAPPEDFILE_HPP__
+
+#include <string>
+#include <cstddef>
+
+/* Read-only memory mapping of an entire file.
+ * The mapping is released when the object is destroyed.
+ */
+namespace engine
+{
+    class mappedfile
+    {
+        public:
+            mappedfile();
+            mappedfile(std::string filepath);
+            ~mappedfile();
+
+            /* map a file, releasing any previous mapping */
+            bool open(std::string filepath);
+            void close();
+
+            /* drop the pages of a range that has been read from memory,
+             * keeping the mapping; they are read back in if touched again
+             */
+            void release(size_t offset, size_t size);
+
+            bool isOpen() const;
+            const char *data() const;
+            size_t size() const;
+
+        private:
+            const char *begin;
+            size_t length;
+            bool opened;
+
+            /* mappings are not copyable */
+            mappedfile(const mappedfile& f);
+            mappedfile& operator=(const mappedfile& f);
+    };
+}
+
+#endif  // ifndef __MAPPEDFILE_HPP__
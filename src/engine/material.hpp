@@ -0,0 +1,21 @@
+#ifndef __MATERIAL_HPP__
+#define __MATERIAL_HPP__
+
+#include "includes/glm_include.hpp"
+
+/* Material constants shared by the mesh cache and the material texture
+ * buffer
+ */
+namespace engine
+{
+    /* two RGBA32F texels of the materials texture buffer in
+     * lambertian.frag
+     */
+    struct material
+    {
+        glm::vec4 diffuse;
+        glm::vec4 ambient;
+    };
+}
+
+#endif  // ifndef __MATERIAL_HPP__
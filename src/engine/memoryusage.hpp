@@ -0,0 +1,28 @@
+#ifndef __MEMORYUSAGE_HPP__
+#define __MEMORYUSAGE_HPP__
+
+#include <cstddef>
+#include <sys/resource.h>
+
+/* Process memory statistics used for load and conversion reporting
+ */
+namespace engine
+{
+    /* largest resident set size of the process so far, in bytes */
+    inline size_t peakResidentBytes()
+    {
+        struct rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        // Linux reports kilobytes
+        return size_t(usage.ru_maxrss)*1024;
+#endif
+    }
+}
+
+#endif  // ifndef __MEMORYUSAGE_HPP__
@@ -1,13 +1,17 @@
 #ifndef __MESH_HPP__
 #define __MESH_HPP__
 
-#include <vector>
 #include <string>
+#include <memory>
 
 #include "includes/glm_include.hpp"
 #include "includes/gl_include.h"
 #include "engine/light.hpp"
+#include "engine/asset.hpp"
 
+/* One instance of a shared asset placed in the world.  Copies share the
+ * asset, so meshes are cheap to copy and store in containers.
+ */
 namespace engine
 {
     class mesh
@@ -15,38 +19,28 @@ namespace engine
         public:
             mesh();
             mesh(std::string filepath, glm::mat4 modelMatrix);
-            mesh(const mesh& m);
-            mesh& operator=(const mesh& m);
-            ~mesh();
+            mesh(std::shared_ptr<asset> geometry, glm::mat4 modelMatrix);
 
-            /* given a shadowmap, draw the mesh using one light source */
-            void draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, light l,
-                    GLuint shadowTexture, glm::vec3 shadowmapSize);
+            /* whether the mesh's asset is fully uploaded and drawable */
+            bool isResident() const;
 
-            /* draw the shadowmap from the perspective of one light source */
-            void drawShadowmap(light l, glm::vec3 shadowmapSize);
+            /* the shared asset drawn, and the attributes of this
+             * instance of it
+             */
+            asset *source() const;
+            const meshinstance &instance() const;
 
             /* apply transformations to the mesh */
             void translate(glm::vec3 delta);
             void rotate(float angle, glm::vec3 axis);
 
         private:
-            /* mesh data */
-            std::vector<glm::vec3> vertices;
-            std::vector<glm::vec2> textureUVs;
-            std::vector<glm::vec3> normals;
-            glm::vec3 diffuse, ambient;
-            glm::mat4 modelMatrix;
-
-            /* buffers and programs for rendering */
-            GLuint shadowProgramID, renderProgramID;
-            GLuint vertexBuffer, normalBuffer;
-
-            /* constructor helpers */
-            void loadMesh(std::string filepath);
-            void loadMaterial(std::string mtlpath);
-            void initShaders();
-            void initBuffers();
+            std::shared_ptr<asset> geometry;
+
+            /* model matrix, and the normal matrix kept up to date with it */
+            meshinstance placement;
+
+            void setModelMatrix(glm::mat4 modelMatrix);
     };
 }
 
@@ -0,0 +1,167 @@
+#include "engine/meshbuild.hpp"
+#include "engine/objparser.hpp"
+#include "engine/meshindex.hpp"
+#include "engine/meshoptimize.hpp"
+#include "engine/meshsimplify.hpp"
+#include "engine/meshlet.hpp"
+
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <map>
+
+using namespace engine;
+
+bool engine::buildmesh(std::string objpath, std::string path, bool compact,
+        bool compressed, meshcache &geometry)
+{
+    objdata obj;
+    if(!parseobj(objpath, obj))
+    {
+        std::cout << objpath << " not found!\n";
+        return false;
+    }
+
+    // Material libraries are resolved relative to the OBJ file
+    std::string directory;
+    size_t slash = objpath.find_last_of('/');
+    if(slash != std::string::npos)
+    {
+        directory = objpath.substr(0, slash + 1);
+    }
+
+    // Deduplicate face corners into indexed vertices
+    meshdata mesh;
+    std::vector<vertex> &vertices = mesh.vertices;
+    std::vector<uint32_t> &indices = mesh.indices;
+    if(!indexcorners(obj, vertices, indices))
+    {
+        std::cout << objpath << ": face index out of range!\n";
+        return false;
+    }
+    size_t indexSize = vertices.size() <= 0x10000 ? 2 : 4;
+    std::cout << objpath << ": " << indices.size() << " corners indexed into "
+        << vertices.size() << " vertices ("
+        << indices.size()*sizeof(vertex)/1024 << " KB -> "
+        << (vertices.size()*sizeof(vertex) + indices.size()*indexSize)/1024
+        << " KB)\n";
+
+    // Sort triangles into one range per material; corners before any
+    // usemtl take a default material after the named ones
+    uint32_t defaultMaterial = obj.materials.size();
+    std::vector<uint32_t> groups(indices.size()/3, defaultMaterial);
+    for(size_t r = 0; r < obj.materialRuns.size(); r++)
+    {
+        size_t end = r + 1 < obj.materialRuns.size() ?
+            obj.materialRuns[r + 1].firstCorner : obj.corners.size();
+        std::fill(groups.begin() + obj.materialRuns[r].firstCorner/3,
+                groups.begin() + end/3, obj.materialRuns[r].material);
+    }
+    sortbygroup(indices, groups);
+    std::vector<indexrange> &ranges = mesh.ranges;
+    groupranges(groups, 0, ranges);
+
+    // Reorder for the post-transform cache, overdraw and vertex fetch
+    cachestats before = analyzevertexcache(indices, vertices.size());
+    optimizemesh(vertices, indices, ranges);
+    cachestats after = analyzevertexcache(indices, vertices.size());
+    std::cout << objpath << ": ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+
+    // Simplify into coarser levels sharing the same vertices; whether the
+    // surface is closed is decided on the full mesh
+    bool closed = isclosed(vertices, indices);
+    std::vector<meshlod> &lods = mesh.lods;
+    buildlods(vertices, indices, ranges, lods);
+    std::cout << objpath << ": levels of detail";
+    for(size_t i = 0; i < lods.size(); i++)
+    {
+        std::cout << (i ? ", " : " ") << lods[i].indexCount/3
+            << " triangles (error " << lods[i].error << ")";
+    }
+    std::cout << "\n";
+
+    // Split every range of every level into meshlets for culling
+    buildmeshlets(vertices, indices, ranges, closed, mesh.meshlets,
+            mesh.rangeMeshlets);
+    std::cout << objpath << ": " << mesh.meshlets.size() << " meshlets"
+        << (closed ? "" : ", open surface without normal cones") << "\n";
+
+    std::string mtlpath = directory + obj.mtllib;
+    std::vector<material> &materials = mesh.materials;
+    if(!loadmaterials(mtlpath, obj.materials, materials))
+    {
+        return false;
+    }
+    if(!groups.empty() && groups.back() == defaultMaterial)
+    {
+        material fallback = {glm::vec4(1.0f), glm::vec4(0.0f)};
+        materials.push_back(fallback);
+    }
+    std::cout << objpath << ": " << materials.size() << " materials in "
+        << lods[0].rangeCount << " ranges\n";
+
+    geometry.store(path, objpath, mtlpath, mesh, compact, compressed);
+    return true;
+}
+
+bool engine::loadmaterials(std::string mtlpath, const std::vector<std::string> &names,
+        std::vector<material> &materials)
+{
+    std::ifstream mtlfile(mtlpath.c_str());
+    if(!mtlfile)
+    {
+        std::cout << mtlpath << " not found!\n";
+        return false;
+    }
+
+    // Only materials the OBJ uses are kept, in the order it names them
+    std::map<std::string, size_t> lookup;
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        lookup[names[i]] = i;
+    }
+    material fallback = {glm::vec4(1.0f), glm::vec4(0.0f)};
+    materials.assign(names.size(), fallback);
+    std::vector<bool> defined(names.size(), false);
+
+    material *current = 0;
+    std::string line;
+    while(getline(mtlfile, line))
+    {
+        std::istringstream iss(line);
+        std::string type;
+        iss >> type;
+
+        if(type == "newmtl")
+        {
+            std::string name;
+            iss >> name;
+            std::map<std::string, size_t>::iterator it = lookup.find(name);
+            current = it == lookup.end() ? 0 : &materials[it->second];
+            if(current)
+            {
+                defined[it->second] = true;
+            }
+        }
+        else if(type == "Kd" && current)
+        {
+            iss >> current->diffuse.x >> current->diffuse.y >> current->diffuse.z;
+        }
+        else if(type == "Ka" && current)
+        {
+            iss >> current->ambient.x >> current->ambient.y >> current->ambient.z;
+        }
+    }
+
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        if(!defined[i])
+        {
+            std::cout << mtlpath << ": material " << names[i]
+                << " not found, using default\n";
+        }
+    }
+    return true;
+}
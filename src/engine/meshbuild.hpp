@@ -0,0 +1,33 @@
+#ifndef __MESHBUILD_HPP__
+#define __MESHBUILD_HPP__
+
+#include <string>
+#include <vector>
+
+#include "engine/meshcache.hpp"
+
+/* Conversion of OBJ and MTL sources into load-ready geometry, shared by
+ * the runtime loader and the bake tool.  Nothing here touches GL.
+ */
+namespace engine
+{
+    /* Parse an OBJ file and its material library, index its corners,
+     * group triangles by material, optimize them, build levels of detail
+     * and split them into meshlets, then store the result at path through
+     * geometry, with vertices quantized when compact is set.  Returns false if a source
+     * is missing or malformed; if only writing failed, geometry still holds
+     * the result in memory and is not mapped.  Vertices and indices are
+     * stored compressed when compressed is set.
+     */
+    bool buildmesh(std::string objpath, std::string path, bool compact,
+            bool compressed, meshcache &geometry);
+
+    /* Read the Kd and Ka colors of the named materials from an MTL file,
+     * in the order of names; missing ones keep default colors.  Returns
+     * false if the file cannot be opened.
+     */
+    bool loadmaterials(std::string mtlpath, const std::vector<std::string> &names,
+            std::vector<material> &materials);
+}
+
+#endif  // ifndef __MESHBUILD_HPP__
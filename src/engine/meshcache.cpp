@@ -0,0 +1,819 @@
+#include "engine/meshcache.hpp"
+#include "engine/hash.hpp"
+#include "engine/spillfile.hpp"
+#include "engine/meshcodec.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+
+using namespace engine;
+
+namespace
+{
+    const char cacheMagic[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+    const uint32_t cacheVersion = 8;
+
+    /* size and modification time of a file */
+    bool statFile(std::string path, uint64_t &size, int64_t &mtime)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        size = st.st_size;
+        mtime = st.st_mtime;
+        return true;
+    }
+
+
+    bool writeBytes(FILE *out, const void *data, size_t size)
+    {
+        return size == 0 || fwrite(data, 1, size, out) == size;
+    }
+
+    inline size_t padTo8(size_t size)
+    {
+        return (size + 7) & ~size_t(7);
+    }
+
+    void storeVec3(float *dst, glm::vec3 v)
+    {
+        dst[0] = v.x;
+        dst[1] = v.y;
+        dst[2] = v.z;
+    }
+
+    /* Payloads are checksummed a block at a time, each block's hash
+     * seeding the next, so a payload can be hashed while it is streamed
+     */
+    const size_t checksumBlock = 1 << 20;
+    const uint64_t checksumSeed = 0x9e3779b97f4a7c15ULL;
+
+    uint64_t hashPayload(const char *payload, size_t size)
+    {
+        uint64_t checksum = checksumSeed;
+        for(size_t offset = 0; offset < size; offset += checksumBlock)
+        {
+            checksum = hashBytes(payload + offset,
+                    std::min(checksumBlock, size - offset), checksum);
+        }
+        return checksum;
+    }
+
+    /* Sources are hashed like payloads, dropping each block once hashed
+     * so large OBJ files are never resident at once
+     */
+    uint64_t hashFile(std::string path)
+    {
+        mappedfile file(path);
+        uint64_t checksum = checksumSeed;
+        for(size_t offset = 0; offset < file.size(); offset += checksumBlock)
+        {
+            size_t size = std::min(checksumBlock, file.size() - offset);
+            checksum = hashBytes(file.data() + offset, size, checksum);
+            file.release(offset, size);
+        }
+        return checksum;
+    }
+
+    /* Writes a payload to a file through one block of memory, computing
+     * the same checksum as hashPayload
+     */
+    class payloadwriter
+    {
+        public:
+            payloadwriter(FILE *out) :
+                out(out),
+                block(),
+                checksum(checksumSeed),
+                size(0),
+                failed(false)
+            {
+                block.reserve(checksumBlock);
+            }
+
+            void write(const void *data, size_t bytes)
+            {
+                const char *p = static_cast<const char*>(data);
+                while(bytes > 0)
+                {
+                    size_t slice = std::min(bytes, checksumBlock - block.size());
+                    block.insert(block.end(), p, p + slice);
+                    p += slice;
+                    bytes -= slice;
+                    size += slice;
+                    if(block.size() == checksumBlock)
+                    {
+                        flush();
+                    }
+                }
+            }
+
+            /* zero fill up to the next section */
+            void pad()
+            {
+                static const char zeros[8] = {0};
+                write(zeros, padTo8(size) - size);
+            }
+
+            bool finish(uint64_t &result)
+            {
+                flush();
+                result = checksum;
+                return !failed;
+            }
+
+        private:
+            FILE *out;
+            std::vector<char> block;
+            uint64_t checksum;
+            size_t size;
+            bool failed;
+
+            void flush()
+            {
+                if(!block.empty())
+                {
+                    checksum = hashBytes(&block[0], block.size(), checksum);
+                    failed = !writeBytes(out, &block[0], block.size()) || failed;
+                    block.clear();
+                }
+            }
+    };
+}
+
+meshcache::meshcache() :
+    info(),
+    file(),
+    owned(),
+    decoded(),
+    vertexData(0),
+    indexData(0),
+    materialData(0),
+    rangeData(0),
+    meshletData(0)
+{}
+
+std::string meshcache::cachePath(std::string objpath)
+{
+    return objpath + ".cache";
+}
+
+std::string meshcache::bakedPath(std::string objpath)
+{
+    size_t dot = objpath.find_last_of('.');
+    if(dot != std::string::npos && objpath.find('/', dot) == std::string::npos)
+    {
+        objpath.erase(dot);
+    }
+    return objpath + ".mesh";
+}
+
+bool meshcache::isBakedPath(std::string path)
+{
+    return path.size() > 5 && path.compare(path.size() - 5, 5, ".mesh") == 0;
+}
+
+bool meshcache::open(std::string objpath)
+{
+    return open(objpath, cachePath(objpath));
+}
+
+bool meshcache::open(std::string objpath, std::string path)
+{
+    if(!mapHeader(path))
+    {
+        return false;
+    }
+
+    // Sources must be unchanged since the cache was written
+    uint64_t size;
+    int64_t mtime;
+    if(!statFile(objpath, size, mtime) ||
+            size != info.objSize || mtime != info.objMtime ||
+            !statFile(info.mtlpath, size, mtime) ||
+            size != info.mtlSize || mtime != info.mtlMtime ||
+            hashFile(info.mtlpath) != info.mtlHash)
+    {
+        std::cout << path << ": sources changed, rebuilding\n";
+        file.close();
+        return false;
+    }
+    return mapPayload(path);
+}
+
+bool meshcache::openBaked(std::string path)
+{
+    return mapHeader(path) && mapPayload(path);
+}
+
+bool meshcache::mapHeader(std::string path)
+{
+    if(!file.open(path))
+    {
+        return false;
+    }
+
+    // Check format before trusting any header fields
+    if(file.size() < sizeof(header))
+    {
+        file.close();
+        return false;
+    }
+    memcpy(&info, file.data(), sizeof(header));
+    if(memcmp(info.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+            info.version != cacheVersion ||
+            info.headerSize != sizeof(header) ||
+            (info.vertexSize != sizeof(vertex) &&
+             info.vertexSize != sizeof(compactvertex)) ||
+            (info.indexSize != 2 && info.indexSize != 4) ||
+            (!info.compressed &&
+             (info.vertexDataSize != info.vertexCount*info.vertexSize ||
+              info.indexDataSize != info.indexCount*info.indexSize)) ||
+            (info.compressed &&
+             (info.vertexDataSize < (info.vertexCount + 15)/16*((info.vertexSize + 3)/4) ||
+              info.indexDataSize < (info.indexCount + 15)/16)) ||
+            file.size() != info.headerSize + payloadSize())
+    {
+        std::cout << path << ": stale cache format, rebuilding\n";
+        file.close();
+        return false;
+    }
+    info.mtlpath[sizeof(info.mtlpath) - 1] = '\0';
+
+    // Every level must lie within the index data and range table
+    bool lodsValid = info.lodCount >= 1 && info.lodCount <= maxLods;
+    for(uint32_t i = 0; lodsValid && i < info.lodCount; i++)
+    {
+        lodsValid = info.lodIndexOffset[i] <= info.indexCount &&
+            info.lodIndexCount[i] <= info.indexCount - info.lodIndexOffset[i] &&
+            info.lodFirstRange[i] <= info.rangeCount &&
+            info.lodRangeCount[i] <= info.rangeCount - info.lodFirstRange[i];
+    }
+    if(!lodsValid)
+    {
+        std::cout << path << ": invalid levels of detail, rebuilding\n";
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool meshcache::mapPayload(std::string path)
+{
+    const char *payload = file.data() + info.headerSize;
+    size_t payloadSize = file.size() - info.headerSize;
+    if(hashPayload(payload, payloadSize) != info.payloadChecksum)
+    {
+        std::cout << path << ": checksum mismatch, rebuilding\n";
+        file.close();
+        return false;
+    }
+    if(!decodeSections(payload))
+    {
+        std::cout << path << ": corrupt compressed geometry, rebuilding\n";
+        file.close();
+        return false;
+    }
+
+    locateSections(payload);
+
+    // Ranges are checked once the payload is known to be intact
+    for(uint32_t i = 0; i < info.rangeCount; i++)
+    {
+        const rangerecord &r = rangeData[i];
+        if(r.material >= info.materialCount || r.indexOffset > info.indexCount ||
+                r.indexCount > info.indexCount - r.indexOffset ||
+                r.firstMeshlet > info.meshletCount ||
+                r.meshletCount > info.meshletCount - r.firstMeshlet)
+        {
+            std::cout << path << ": invalid material ranges, rebuilding\n";
+            file.close();
+            return false;
+        }
+    }
+    for(uint64_t i = 0; i < info.meshletCount; i++)
+    {
+        const meshlet &m = meshletData[i];
+        if(m.indexOffset > info.indexCount ||
+                m.indexCount > info.indexCount - m.indexOffset)
+        {
+            std::cout << path << ": invalid meshlets, rebuilding\n";
+            file.close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool meshcache::store(std::string path, std::string objpath, std::string mtlpath,
+        const meshdata &mesh, bool compact, bool compressed)
+{
+    file.close();
+    std::vector<char>().swap(decoded);
+    const std::vector<vertex> &vertices = mesh.vertices;
+    const std::vector<uint32_t> &indices = mesh.indices;
+    const std::vector<indexrange> &ranges = mesh.ranges;
+    const std::vector<material> &materials = mesh.materials;
+
+    glm::vec3 lower, upper;
+    if(!vertices.empty())
+    {
+        lower = upper = vertices[0].position;
+    }
+    for(size_t i = 1; i < vertices.size(); i++)
+    {
+        lower = glm::min(lower, vertices[i].position);
+        upper = glm::max(upper, vertices[i].position);
+    }
+    std::vector<compactvertex> packed;
+    if(compact && !vertices.empty())
+    {
+        packvertices(&vertices[0], vertices.size(), lower, upper, packed);
+    }
+    fillHeader(objpath, mtlpath, vertices.size(), indices.size(), materials.size(),
+            ranges.size(), mesh.meshlets.size(), mesh.lods, lower, upper, compact,
+            compressed);
+
+    std::vector<unsigned char> encodedVertices, encodedIndices;
+    if(compressed)
+    {
+        if(!vertices.empty())
+        {
+            encodevertices(compact ? static_cast<const void*>(&packed[0]) :
+                    static_cast<const void*>(&vertices[0]), vertices.size(),
+                    info.vertexSize, encodedVertices);
+        }
+        if(!indices.empty())
+        {
+            encodeindices(&indices[0], indices.size(), info.indexSize, encodedIndices);
+        }
+        info.vertexDataSize = encodedVertices.size();
+        info.indexDataSize = encodedIndices.size();
+    }
+
+    // Lay out the payload in memory exactly as it is written to disk
+    std::vector<char>(payloadSize(), 0).swap(owned);
+    char *payload = owned.empty() ? 0 : &owned[0];
+    if(compressed)
+    {
+        std::copy(encodedVertices.begin(), encodedVertices.end(), payload);
+        std::copy(encodedIndices.begin(), encodedIndices.end(), payload + vertexBytes());
+    }
+    for(size_t i = 0; !compressed && i < vertices.size(); i++)
+    {
+        if(compact)
+        {
+            memcpy(payload + i*sizeof(compactvertex), &packed[i], sizeof(compactvertex));
+        }
+        else
+        {
+            memcpy(payload + i*sizeof(vertex), &vertices[i], sizeof(vertex));
+        }
+    }
+    char *indexPayload = payload + vertexBytes();
+    for(size_t i = 0; !compressed && i < indices.size(); i++)
+    {
+        if(info.indexSize == 2)
+        {
+            uint16_t index = indices[i];
+            memcpy(indexPayload + i*2, &index, 2);
+        }
+        else
+        {
+            memcpy(indexPayload + i*4, &indices[i], 4);
+        }
+    }
+    char *materialPayload = indexPayload + indexBytes();
+    for(size_t i = 0; i < materials.size(); i++)
+    {
+        memcpy(materialPayload + i*sizeof(material), &materials[i], sizeof(material));
+    }
+    char *rangePayload = materialPayload + materialBytes();
+    for(size_t i = 0; i < ranges.size(); i++)
+    {
+        rangerecord record = makeRange(ranges[i], mesh.rangeMeshlets, i);
+        memcpy(rangePayload + i*sizeof(rangerecord), &record, sizeof(rangerecord));
+    }
+    char *meshletPayload = rangePayload + rangeBytes();
+    for(size_t i = 0; i < mesh.meshlets.size(); i++)
+    {
+        memcpy(meshletPayload + i*sizeof(meshlet), &mesh.meshlets[i], sizeof(meshlet));
+    }
+    decodeSections(payload);
+    locateSections(payload);
+    info.payloadChecksum = hashPayload(payload, owned.size());
+
+    if(mtlpath.size() >= sizeof(info.mtlpath))
+    {
+        return false;
+    }
+
+    // Write to a temporary file and rename it into place so readers never
+    // map a partially written cache
+    std::string temppath = path + ".tmp";
+    FILE *out = fopen(temppath.c_str(), "wb");
+    if(!out)
+    {
+        std::cout << path << ": could not write cache\n";
+        return false;
+    }
+    bool written = fwrite(&info, sizeof(header), 1, out) == 1 &&
+        writeBytes(out, payload, owned.size());
+    written = fclose(out) == 0 && written;
+    if(!written || rename(temppath.c_str(), path.c_str()) != 0)
+    {
+        std::cout << path << ": could not write cache\n";
+        remove(temppath.c_str());
+        return false;
+    }
+
+    // Serve the geometry from the cache mapping from now on
+    if(file.open(path) && file.size() == sizeof(header) + payloadSize())
+    {
+        locateSections(file.data() + sizeof(header));
+        std::vector<char>().swap(owned);
+    }
+    else
+    {
+        file.close();
+    }
+    return true;
+}
+
+bool meshcache::store(std::string path, std::string objpath, std::string mtlpath,
+        const streamedmesh &mesh, bool compact, bool compressed)
+{
+    file.close();
+    std::vector<char>().swap(owned);
+    std::vector<char>().swap(decoded);
+    vertexData = indexData = 0;
+    materialData = 0;
+    rangeData = 0;
+    meshletData = 0;
+    fillHeader(objpath, mtlpath, mesh.vertexCount, mesh.indexCount,
+            mesh.materials.size(), mesh.ranges.size(), mesh.meshletCount, mesh.lods,
+            mesh.boundsMin, mesh.boundsMax, compact, compressed);
+    if(mtlpath.size() >= sizeof(info.mtlpath))
+    {
+        return false;
+    }
+
+    std::string temppath = path + ".tmp";
+    FILE *out = fopen(temppath.c_str(), "wb");
+    if(!out)
+    {
+        std::cout << path << ": could not write cache\n";
+        return false;
+    }
+
+    // The header is rewritten once the payload checksum is known
+    bool written = fwrite(&info, sizeof(header), 1, out) == 1;
+    payloadwriter payload(out);
+
+    // Vertices and indices are converted a chunk at a time, and chunks of
+    // whole codec pages compress exactly as the whole stream would
+    const size_t chunkSize = 2*codecPageSize;
+    std::vector<unsigned char> encoded;
+    if(compressed)
+    {
+        info.vertexDataSize = info.indexDataSize = 0;
+    }
+    spillreader<vertex> vertexInput;
+    std::vector<vertex> vertexChunk;
+    std::vector<compactvertex> packed;
+    written = vertexInput.open(mesh.vertexPath) && written;
+    for(size_t i = 0; written && i < mesh.vertexCount; i += vertexChunk.size())
+    {
+        vertexChunk.resize(std::min(chunkSize, mesh.vertexCount - i));
+        for(size_t k = 0; written && k < vertexChunk.size(); k++)
+        {
+            written = vertexInput.read(vertexChunk[k]);
+        }
+        const void *chunk = &vertexChunk[0];
+        if(compact)
+        {
+            packvertices(&vertexChunk[0], vertexChunk.size(), mesh.boundsMin,
+                    mesh.boundsMax, packed);
+            chunk = &packed[0];
+        }
+        if(compressed)
+        {
+            encoded.clear();
+            encodevertices(chunk, vertexChunk.size(), info.vertexSize, encoded);
+            payload.write(&encoded[0], encoded.size());
+            info.vertexDataSize += encoded.size();
+        }
+        else
+        {
+            payload.write(chunk, vertexChunk.size()*info.vertexSize);
+        }
+    }
+    payload.pad();
+
+    spillreader<uint32_t> indexInput;
+    std::vector<uint32_t> indexChunk;
+    std::vector<uint16_t> shortIndices;
+    written = indexInput.open(mesh.indexPath) && written;
+    for(size_t i = 0; written && i < mesh.indexCount; i += indexChunk.size())
+    {
+        indexChunk.resize(std::min(chunkSize, mesh.indexCount - i));
+        for(size_t k = 0; written && k < indexChunk.size(); k++)
+        {
+            written = indexInput.read(indexChunk[k]);
+        }
+        if(compressed)
+        {
+            encoded.clear();
+            encodeindices(&indexChunk[0], indexChunk.size(), info.indexSize, encoded);
+            payload.write(&encoded[0], encoded.size());
+            info.indexDataSize += encoded.size();
+        }
+        else if(info.indexSize == 2)
+        {
+            shortIndices.assign(indexChunk.begin(), indexChunk.end());
+            payload.write(&shortIndices[0], shortIndices.size()*2);
+        }
+        else
+        {
+            payload.write(&indexChunk[0], indexChunk.size()*4);
+        }
+    }
+    payload.pad();
+
+    payload.write(mesh.materials.empty() ? 0 : &mesh.materials[0],
+            mesh.materials.size()*sizeof(material));
+    for(size_t i = 0; i < mesh.ranges.size(); i++)
+    {
+        rangerecord record = makeRange(mesh.ranges[i], mesh.rangeMeshlets, i);
+        payload.write(&record, sizeof(rangerecord));
+    }
+    spillreader<meshlet> meshletInput;
+    written = meshletInput.open(mesh.meshletPath) && written;
+    for(size_t i = 0; written && i < mesh.meshletCount; i++)
+    {
+        meshlet m;
+        written = meshletInput.read(m);
+        payload.write(&m, sizeof(meshlet));
+    }
+
+    written = payload.finish(info.payloadChecksum) && written &&
+        fseek(out, 0, SEEK_SET) == 0 &&
+        fwrite(&info, sizeof(header), 1, out) == 1;
+    written = fclose(out) == 0 && written;
+    if(!written || rename(temppath.c_str(), path.c_str()) != 0)
+    {
+        std::cout << path << ": could not write cache\n";
+        remove(temppath.c_str());
+        return false;
+    }
+
+    // Map the result, which is only paged in when used
+    if(file.open(path) && file.size() == sizeof(header) + payloadSize())
+    {
+        locateSections(file.data() + sizeof(header));
+    }
+    else
+    {
+        file.close();
+    }
+    return true;
+}
+
+meshcache::rangerecord meshcache::makeRange(const indexrange &range,
+        const std::vector<std::pair<size_t, size_t> > &rangeMeshlets, size_t i)
+{
+    std::pair<size_t, size_t> clusters(0, 0);
+    if(i < rangeMeshlets.size())
+    {
+        clusters = rangeMeshlets[i];
+    }
+    rangerecord record = {range.group, uint32_t(clusters.second),
+        range.indexOffset, range.indexCount, clusters.first};
+    return record;
+}
+
+void meshcache::fillHeader(std::string objpath, std::string mtlpath,
+        size_t vertexCount, size_t indexCount, size_t materialCount,
+        size_t rangeCount, size_t meshletCount, const std::vector<meshlod> &lods,
+        glm::vec3 lower, glm::vec3 upper, bool compact, bool compressed)
+{
+    memset(&info, 0, sizeof(header));
+    memcpy(info.magic, cacheMagic, sizeof(cacheMagic));
+    info.version = cacheVersion;
+    info.headerSize = sizeof(header);
+    info.vertexCount = vertexCount;
+    info.vertexSize = compact ? sizeof(compactvertex) : sizeof(vertex);
+    info.indexCount = indexCount;
+    info.indexSize = vertexCount <= 0x10000 ? 2 : 4;
+    info.compressed = compressed;
+    info.vertexDataSize = info.vertexCount*info.vertexSize;
+    info.indexDataSize = info.indexCount*info.indexSize;
+    info.materialCount = materialCount;
+    info.rangeCount = rangeCount;
+    info.meshletCount = meshletCount;
+    info.lodCount = std::min<size_t>(lods.size(), maxLods);
+    for(uint32_t i = 0; i < info.lodCount; i++)
+    {
+        info.lodError[i] = lods[i].error;
+        info.lodIndexOffset[i] = lods[i].indexOffset;
+        info.lodIndexCount[i] = lods[i].indexCount;
+        info.lodFirstRange[i] = lods[i].firstRange;
+        info.lodRangeCount[i] = lods[i].rangeCount;
+    }
+
+    statFile(objpath, info.objSize, info.objMtime);
+    info.objHash = hashFile(objpath);
+    statFile(mtlpath, info.mtlSize, info.mtlMtime);
+    info.mtlHash = hashFile(mtlpath);
+    strncpy(info.mtlpath, mtlpath.c_str(), sizeof(info.mtlpath) - 1);
+    storeVec3(info.boundsMin, lower);
+    storeVec3(info.boundsMax, upper);
+}
+
+bool meshcache::isMapped() const
+{
+    return file.isOpen();
+}
+
+bool meshcache::isCompact() const
+{
+    return info.vertexSize == sizeof(compactvertex);
+}
+
+bool meshcache::isCompressed() const
+{
+    return info.compressed != 0;
+}
+
+const vertex *meshcache::vertices() const
+{
+    return isCompact() ? 0 : static_cast<const vertex*>(vertexData);
+}
+
+const compactvertex *meshcache::packedVertices() const
+{
+    return isCompact() ? static_cast<const compactvertex*>(vertexData) : 0;
+}
+
+size_t meshcache::vertexCount() const
+{
+    return info.vertexCount;
+}
+
+const void *meshcache::indices() const
+{
+    return indexData;
+}
+
+size_t meshcache::indexCount() const
+{
+    return info.indexCount;
+}
+
+size_t meshcache::indexSize() const
+{
+    return info.indexSize;
+}
+
+size_t meshcache::lodCount() const
+{
+    return info.lodCount;
+}
+
+meshlod meshcache::lod(size_t level) const
+{
+    meshlod result = {size_t(info.lodIndexOffset[level]),
+        size_t(info.lodIndexCount[level]), info.lodFirstRange[level],
+        info.lodRangeCount[level], info.lodError[level]};
+    return result;
+}
+
+size_t meshcache::rangeCount() const
+{
+    return info.rangeCount;
+}
+
+indexrange meshcache::range(size_t i) const
+{
+    indexrange result = {rangeData[i].material, size_t(rangeData[i].indexOffset),
+        size_t(rangeData[i].indexCount)};
+    return result;
+}
+
+const meshlet *meshcache::meshlets() const
+{
+    return meshletData;
+}
+
+size_t meshcache::meshletCount() const
+{
+    return info.meshletCount;
+}
+
+std::pair<size_t, size_t> meshcache::rangeMeshlets(size_t i) const
+{
+    return std::make_pair(size_t(rangeData[i].firstMeshlet),
+            size_t(rangeData[i].meshletCount));
+}
+
+const material *meshcache::materials() const
+{
+    return materialData;
+}
+
+size_t meshcache::materialCount() const
+{
+    return info.materialCount;
+}
+
+size_t meshcache::vertexBytes() const
+{
+    return padTo8(info.vertexDataSize);
+}
+
+size_t meshcache::indexBytes() const
+{
+    return padTo8(info.indexDataSize);
+}
+
+size_t meshcache::materialBytes() const
+{
+    return info.materialCount*sizeof(material);
+}
+
+size_t meshcache::rangeBytes() const
+{
+    return info.rangeCount*sizeof(rangerecord);
+}
+
+size_t meshcache::payloadSize() const
+{
+    return vertexBytes() + indexBytes() + materialBytes() + rangeBytes() +
+        info.meshletCount*sizeof(meshlet);
+}
+
+void meshcache::locateSections(const char *payload)
+{
+    vertexData = payload;
+    indexData = payload + vertexBytes();
+    if(info.compressed)
+    {
+        const char *data = decoded.empty() ? 0 : &decoded[0];
+        vertexData = data;
+        indexData = data ? data + padTo8(info.vertexCount*info.vertexSize) : 0;
+    }
+    materialData = reinterpret_cast<const material*>(
+            payload + vertexBytes() + indexBytes());
+    rangeData = reinterpret_cast<const rangerecord*>(
+            payload + vertexBytes() + indexBytes() + materialBytes());
+    meshletData = reinterpret_cast<const meshlet*>(
+            payload + vertexBytes() + indexBytes() + materialBytes() + rangeBytes());
+}
+
+bool meshcache::decodeSections(const char *payload)
+{
+    if(!info.compressed)
+    {
+        return true;
+    }
+
+    // Decoded data is laid out like an uncompressed payload
+    size_t vertexSize = padTo8(info.vertexCount*info.vertexSize);
+    std::vector<char>(vertexSize + info.indexCount*info.indexSize).swap(decoded);
+    char *data = decoded.empty() ? 0 : &decoded[0];
+    const unsigned char *encoded = reinterpret_cast<const unsigned char*>(payload);
+    if(!decodevertices(data, info.vertexCount, info.vertexSize,
+                encoded, info.vertexDataSize) ||
+            !decodeindices(data + vertexSize, info.indexCount, info.indexSize,
+                encoded + vertexBytes(), info.indexDataSize))
+    {
+        std::vector<char>().swap(decoded);
+        return false;
+    }
+    return true;
+}
+
+glm::vec3 meshcache::boundsMin() const
+{
+    return glm::vec3(info.boundsMin[0], info.boundsMin[1], info.boundsMin[2]);
+}
+
+glm::vec3 meshcache::boundsMax() const
+{
+    return glm::vec3(info.boundsMax[0], info.boundsMax[1], info.boundsMax[2]);
+}
+
+uint64_t meshcache::sourceHash() const
+{
+    return info.objHash ^ mixBits(info.mtlHash);
+}
+
+std::string meshcache::mtlPath() const
+{
+    return info.mtlpath;
+}
@@ -0,0 +1,240 @@
+#ifndef __MESHCACHE_HPP__
+#define __MESHCACHE_HPP__
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "includes/glm_include.hpp"
+#include "engine/mappedfile.hpp"
+#include "engine/vertex.hpp"
+#include "engine/meshsimplify.hpp"
+#include "engine/material.hpp"
+#include "engine/meshlet.hpp"
+
+/* Versioned, checksummed binary cache of a loaded mesh, stored next to
+ * its OBJ file, or baked ahead of time by bin/bake.  A validated cache is
+ * memory-mapped so its vertex and index data can be handed to
+ * glBufferData without any parsing or copying.  Vertices are either full
+ * precision or, in baked meshes, already quantized to the compact
+ * layout.  Indices are 16-bit when every vertex fits, 32-bit otherwise,
+ * and hold every level of detail one after another, each sorted into
+ * one range per material and split into meshlets for culling.  Vertices
+ * and indices may be stored compressed, in which case they are decoded
+ * once when the cache is opened, straight into the memory later handed
+ * to glBufferData.
+ */
+namespace engine
+{
+    /* Geometry built from OBJ and MTL sources, as stored in a cache */
+    struct meshdata
+    {
+        std::vector<vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<indexrange> ranges;
+        std::vector<meshlod> lods;
+        std::vector<material> materials;
+        std::vector<meshlet> meshlets;
+        std::vector<std::pair<size_t, size_t> > rangeMeshlets;
+    };
+
+    /* Geometry too large for memory, as produced by a streaming
+     * conversion: vertices, indices and meshlets are files of vertex,
+     * uint32_t and meshlet records in their final order, read back in
+     * chunks; the rest is as for meshdata
+     */
+    struct streamedmesh
+    {
+        std::string vertexPath, indexPath, meshletPath;
+        size_t vertexCount, indexCount, meshletCount;
+        glm::vec3 boundsMin, boundsMax;
+        std::vector<indexrange> ranges;
+        std::vector<meshlod> lods;
+        std::vector<material> materials;
+        std::vector<std::pair<size_t, size_t> > rangeMeshlets;
+    };
+
+    class meshcache
+    {
+        public:
+            meshcache();
+
+            /* path of the cache file kept for an OBJ file */
+            static std::string cachePath(std::string objpath);
+
+            /* path of the baked mesh for an OBJ file, and whether a path
+             * names a baked mesh
+             */
+            static std::string bakedPath(std::string objpath);
+            static bool isBakedPath(std::string path);
+
+            /* map the cache for an OBJ file, failing if it is missing,
+             * corrupt, from another format version, or older than its
+             * OBJ or MTL sources
+             */
+            bool open(std::string objpath);
+            bool open(std::string objpath, std::string path);
+
+            /* map a baked mesh without checking its sources, which need
+             * not be present
+             */
+            bool openBaked(std::string path);
+
+            /* write freshly built geometry to path and map it, keeping the
+             * geometry in memory instead if it cannot be written; returns
+             * whether it was written
+             */
+            bool store(std::string path, std::string objpath, std::string mtlpath,
+                    const meshdata &mesh, bool compact, bool compressed);
+
+            /* write streamed geometry to path a chunk at a time and map
+             * it; nothing is kept in memory if it cannot be written, and
+             * compressed vertices and indices are only decoded once the
+             * file is opened again
+             */
+            bool store(std::string path, std::string objpath, std::string mtlpath,
+                    const streamedmesh &mesh, bool compact, bool compressed);
+
+            /* whether the geometry is served from a file rather than memory */
+            bool isMapped() const;
+
+            /* vertex data in one of the two layouts, the other being null;
+             * compact positions are quantized against the bounds
+             */
+            bool isCompact() const;
+
+            /* whether vertices and indices are stored compressed */
+            bool isCompressed() const;
+
+            const vertex *vertices() const;
+            const compactvertex *packedVertices() const;
+            size_t vertexCount() const;
+
+            /* index data of all levels, indexSize() bytes per index */
+            const void *indices() const;
+            size_t indexCount() const;
+            size_t indexSize() const;
+
+            /* levels of detail, finest first */
+            size_t lodCount() const;
+            meshlod lod(size_t level) const;
+
+            /* material ranges of all levels, grouped by material index */
+            size_t rangeCount() const;
+            indexrange range(size_t i) const;
+
+            /* meshlets of all ranges, and the first meshlet and count of
+             * each range
+             */
+            const meshlet *meshlets() const;
+            size_t meshletCount() const;
+            std::pair<size_t, size_t> rangeMeshlets(size_t i) const;
+
+            const material *materials() const;
+            size_t materialCount() const;
+            glm::vec3 boundsMin() const;
+            glm::vec3 boundsMax() const;
+
+            /* combined content hash of the OBJ and MTL files the geometry
+             * was loaded from
+             */
+            uint64_t sourceHash() const;
+
+            /* path of the MTL file the geometry was loaded from */
+            std::string mtlPath() const;
+
+        private:
+            struct header
+            {
+                char magic[8];
+                uint32_t version;
+                uint32_t headerSize;
+                uint64_t payloadChecksum;
+                uint64_t vertexCount;
+                uint32_t vertexSize;
+                uint32_t indexSize;
+                uint64_t indexCount;
+
+                /* bytes of vertex and index data in the payload, which are
+                 * the raw sizes unless compressed
+                 */
+                uint32_t compressed;
+                uint32_t reserved;
+                uint64_t vertexDataSize, indexDataSize;
+
+                /* sources the cache was built from */
+                uint64_t objSize, objHash;
+                int64_t objMtime;
+                uint64_t mtlSize, mtlHash;
+                int64_t mtlMtime;
+                char mtlpath[256];
+
+                float boundsMin[3], boundsMax[3];
+                uint32_t materialCount;
+                uint32_t rangeCount;
+                uint64_t meshletCount;
+
+                /* index ranges and errors of the levels of detail */
+                uint32_t lodCount;
+                float lodError[maxLods];
+                uint64_t lodIndexOffset[maxLods];
+                uint64_t lodIndexCount[maxLods];
+                uint32_t lodFirstRange[maxLods];
+                uint32_t lodRangeCount[maxLods];
+            };
+
+            /* fixed layout of a material range in the payload */
+            struct rangerecord
+            {
+                uint32_t material;
+                uint32_t meshletCount;
+                uint64_t indexOffset, indexCount;
+                uint64_t firstMeshlet;
+            };
+
+            header info;
+            mappedfile file;
+            std::vector<char> owned;
+            std::vector<char> decoded;
+            const void *vertexData;
+            const void *indexData;
+            const material *materialData;
+            const rangerecord *rangeData;
+            const meshlet *meshletData;
+
+            /* payload sections, each padded to keep the next aligned */
+            size_t vertexBytes() const;
+            size_t indexBytes() const;
+            size_t materialBytes() const;
+            size_t rangeBytes() const;
+            size_t payloadSize() const;
+            void locateSections(const char *payload);
+
+            /* decode compressed vertices and indices of a payload into
+             * decoded, where locateSections then points them
+             */
+            bool decodeSections(const char *payload);
+
+            /* store helpers: the record of range i, and every header field
+             * but the checksum
+             */
+            static rangerecord makeRange(const indexrange &range,
+                    const std::vector<std::pair<size_t, size_t> > &rangeMeshlets,
+                    size_t i);
+            void fillHeader(std::string objpath, std::string mtlpath,
+                    size_t vertexCount, size_t indexCount, size_t materialCount,
+                    size_t rangeCount, size_t meshletCount,
+                    const std::vector<meshlod> &lods, glm::vec3 lower,
+                    glm::vec3 upper, bool compact, bool compressed);
+
+            /* open helpers: validate the format, then the payload */
+            bool mapHeader(std::string path);
+            bool mapPayload(std::string path);
+
+            /* caches are not copyable */
+            meshcache(const meshcache& c);
+            meshcache& operator=(const meshcache& c);
+    };
+}
+
+#endif  // ifndef __MESHCACHE_HPP__
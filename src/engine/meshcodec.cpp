@@ -0,0 +1,452 @@
+#include "engine/meshcodec.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MESHCODEC_SSE2
+#endif
+
+namespace
+{
+    const size_t blockSize = 16;
+    const size_t blocksPerPage = engine::codecPageSize/blockSize;
+
+    // Bits per element for each 2-bit plane code
+    const unsigned int planeWidths[4] = { 0, 2, 4, 8 };
+
+    size_t headerBytes(size_t stride)
+    {
+        return (stride + 3)/4;
+    }
+
+    unsigned char zigzag8(unsigned char delta)
+    {
+        return (unsigned char)((delta << 1) ^ (delta & 0x80 ? 0xff : 0));
+    }
+
+    unsigned char unzigzag8(unsigned char value)
+    {
+        return (unsigned char)((value >> 1) ^ -(value & 1));
+    }
+
+    uint32_t zigzag32(uint32_t delta, size_t indexSize)
+    {
+        uint32_t sign = indexSize == 2 ? 0x8000 : 0x80000000;
+        uint32_t mask = indexSize == 2 ? 0xffff : 0xffffffff;
+        return ((delta << 1) ^ (delta & sign ? mask : 0)) & mask;
+    }
+
+    uint32_t unzigzag32(uint32_t value)
+    {
+        return (value >> 1) ^ (0 - (value & 1));
+    }
+
+    /* Append one block given as stride planes of blockSize bytes */
+    void encodeBlock(const unsigned char (*planes)[blockSize], size_t stride,
+            std::vector<unsigned char> &out)
+    {
+        size_t header = out.size();
+        out.resize(header + headerBytes(stride), 0);
+        for(size_t k = 0; k < stride; k++)
+        {
+            unsigned char largest = *std::max_element(planes[k], planes[k] + blockSize);
+            unsigned int code = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+            out[header + k/4] |= code << (6 - 2*(k % 4));
+
+            // Elements are packed from the most significant bits down
+            unsigned int width = planeWidths[code];
+            for(size_t i = 0; width > 0 && i < blockSize; i += 8/width)
+            {
+                unsigned char packed = 0;
+                for(size_t j = 0; j < 8/width; j++)
+                {
+                    packed |= planes[k][i + j] << (8 - width*(j + 1));
+                }
+                out.push_back(packed);
+            }
+        }
+    }
+
+    /* Unpack the planes of one block, returning the end of the block or
+     * 0 if it runs past end
+     */
+    const unsigned char *decodePlanes(const unsigned char *data, const unsigned char *end,
+            size_t stride, unsigned char (*planes)[blockSize])
+    {
+        const unsigned char *header = data;
+        if(size_t(end - data) < headerBytes(stride))
+        {
+            return 0;
+        }
+        data += headerBytes(stride);
+        for(size_t k = 0; k < stride; k++)
+        {
+            unsigned int width = planeWidths[(header[k/4] >> (6 - 2*(k % 4))) & 3];
+            if(size_t(end - data) < blockSize*width/8)
+            {
+                return 0;
+            }
+            for(size_t i = 0; i < blockSize; i++)
+            {
+                planes[k][i] = width == 0 ? 0 : (data[i*width/8] >>
+                    (8 - width*(i % (8/width) + 1))) & ((1 << width) - 1);
+            }
+            data += blockSize*width/8;
+        }
+        return data;
+    }
+
+    /* Scalar decoding of one block of up to blockSize elements */
+    const unsigned char *decodeVertexBlock(const unsigned char *data, const unsigned char *end,
+            size_t stride, size_t count, unsigned char *last, unsigned char *destination)
+    {
+        unsigned char planes[engine::maxCodecStride][blockSize];
+        data = decodePlanes(data, end, stride, planes);
+        if(!data)
+        {
+            return 0;
+        }
+        for(size_t i = 0; i < count; i++)
+        {
+            for(size_t k = 0; k < stride; k++)
+            {
+                last[k] += unzigzag8(planes[k][i]);
+                destination[i*stride + k] = last[k];
+            }
+        }
+        return data;
+    }
+
+    const unsigned char *decodeIndexBlock(const unsigned char *data, const unsigned char *end,
+            size_t indexSize, size_t count, uint32_t &last, unsigned char *destination)
+    {
+        unsigned char planes[4][blockSize];
+        data = decodePlanes(data, end, indexSize, planes);
+        if(!data)
+        {
+            return 0;
+        }
+        for(size_t i = 0; i < count; i++)
+        {
+            uint32_t value = 0;
+            for(size_t k = 0; k < indexSize; k++)
+            {
+                value |= uint32_t(planes[k][i]) << (8*k);
+            }
+            last += unzigzag32(value);
+            if(indexSize == 2)
+            {
+                uint16_t index = uint16_t(last);
+                memcpy(destination + 2*i, &index, 2);
+            }
+            else
+            {
+                memcpy(destination + 4*i, &last, 4);
+            }
+        }
+        return data;
+    }
+
+#ifdef MESHCODEC_SSE2
+    /* Unpack one plane of blockSize elements into the bytes of a register */
+    inline __m128i unpackPlane(const unsigned char *&data, unsigned int code)
+    {
+        switch(code)
+        {
+            case 0:
+                return _mm_setzero_si128();
+            case 1:
+            {
+                // Spread each byte over four lanes, then shift each lane's
+                // two bits down
+                int32_t word;
+                memcpy(&word, data, 4);
+                data += 4;
+                __m128i packed = _mm_cvtsi32_si128(word);
+                packed = _mm_unpacklo_epi8(packed, packed);
+                packed = _mm_unpacklo_epi16(packed, packed);
+                __m128i result = _mm_and_si128(_mm_srli_epi16(packed, 6), _mm_set1_epi32(0x00000003));
+                result = _mm_or_si128(result, _mm_and_si128(_mm_srli_epi16(packed, 4), _mm_set1_epi32(0x00000300)));
+                result = _mm_or_si128(result, _mm_and_si128(_mm_srli_epi16(packed, 2), _mm_set1_epi32(0x00030000)));
+                result = _mm_or_si128(result, _mm_and_si128(packed, _mm_set1_epi32(0x03000000)));
+                return result;
+            }
+            case 2:
+            {
+                __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+                data += 8;
+                packed = _mm_unpacklo_epi8(packed, packed);
+                return _mm_or_si128(_mm_and_si128(_mm_srli_epi16(packed, 4), _mm_set1_epi16(0x000f)),
+                    _mm_and_si128(packed, _mm_set1_epi16(0x0f00)));
+            }
+            default:
+            {
+                __m128i plane = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+                data += 16;
+                return plane;
+            }
+        }
+    }
+
+    inline __m128i unzigzagBytes(__m128i value)
+    {
+        __m128i magnitude = _mm_and_si128(_mm_srli_epi16(value, 1), _mm_set1_epi8(0x7f));
+        __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi8(1)));
+        return _mm_xor_si128(magnitude, sign);
+    }
+
+    /* Transpose 16 rows of 16 bytes in place */
+    inline void transpose16(__m128i *rows)
+    {
+        for(int round = 0; round < 4; round++)
+        {
+            __m128i result[16];
+            for(int i = 0; i < 8; i++)
+            {
+                result[2*i] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+                result[2*i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+            }
+            for(int i = 0; i < 16; i++)
+            {
+                rows[i] = result[i];
+            }
+        }
+    }
+
+    /* Decode a full block of vertices whose stride is 16 or 32 bytes */
+    const unsigned char *decodeVertexBlockSSE(const unsigned char *data, const unsigned char *end,
+            size_t stride, unsigned char *last, unsigned char *destination)
+    {
+        // The widest possible block bounds every read below
+        if(size_t(end - data) < headerBytes(stride) + stride*blockSize)
+        {
+            return decodeVertexBlock(data, end, stride, blockSize, last, destination);
+        }
+
+        const unsigned char *header = data;
+        data += headerBytes(stride);
+        __m128i planes[32];
+        for(size_t k = 0; k < stride; k++)
+        {
+            __m128i value = unzigzagBytes(unpackPlane(data, (header[k/4] >> (6 - 2*(k % 4))) & 3));
+
+            // Running byte sum across the block, carried from the last vertex
+            value = _mm_add_epi8(value, _mm_slli_si128(value, 1));
+            value = _mm_add_epi8(value, _mm_slli_si128(value, 2));
+            value = _mm_add_epi8(value, _mm_slli_si128(value, 4));
+            value = _mm_add_epi8(value, _mm_slli_si128(value, 8));
+            value = _mm_add_epi8(value, _mm_set1_epi8(char(last[k])));
+            last[k] = (unsigned char)(uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(value, 12))) >> 24);
+            planes[k] = value;
+        }
+
+        // Planes become vertices, 16 bytes at a time
+        for(size_t half = 0; half < stride/16; half++)
+        {
+            transpose16(planes + 16*half);
+            for(size_t i = 0; i < blockSize; i++)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i*stride + 16*half),
+                    planes[16*half + i]);
+            }
+        }
+        return data;
+    }
+
+    /* Decode a full block of 16 or 32-bit indices */
+    const unsigned char *decodeIndexBlockSSE(const unsigned char *data, const unsigned char *end,
+            size_t indexSize, uint32_t &last, unsigned char *destination)
+    {
+        if(size_t(end - data) < 1 + indexSize*blockSize)
+        {
+            return decodeIndexBlock(data, end, indexSize, blockSize, last, destination);
+        }
+
+        unsigned int header = *data++;
+        __m128i planes[4];
+        for(size_t k = 0; k < indexSize; k++)
+        {
+            planes[k] = unpackPlane(data, (header >> (6 - 2*k)) & 3);
+        }
+
+        __m128i values[4];
+        if(indexSize == 2)
+        {
+            values[0] = _mm_unpacklo_epi8(planes[0], planes[1]);
+            values[1] = _mm_unpackhi_epi8(planes[0], planes[1]);
+            __m128i carry = _mm_set1_epi16(short(last));
+            for(int i = 0; i < 2; i++)
+            {
+                __m128i value = _mm_xor_si128(_mm_srli_epi16(values[i], 1),
+                    _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(values[i], _mm_set1_epi16(1))));
+                value = _mm_add_epi16(value, _mm_slli_si128(value, 2));
+                value = _mm_add_epi16(value, _mm_slli_si128(value, 4));
+                value = _mm_add_epi16(value, _mm_slli_si128(value, 8));
+                value = _mm_add_epi16(value, carry);
+                carry = _mm_shufflehi_epi16(value, 0xff);
+                carry = _mm_unpackhi_epi64(carry, carry);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 16*i), value);
+            }
+            last = uint16_t(_mm_cvtsi128_si32(carry));
+        }
+        else
+        {
+            __m128i low = _mm_unpacklo_epi8(planes[0], planes[1]);
+            __m128i high = _mm_unpackhi_epi8(planes[0], planes[1]);
+            __m128i lowUpper = _mm_unpacklo_epi8(planes[2], planes[3]);
+            __m128i highUpper = _mm_unpackhi_epi8(planes[2], planes[3]);
+            values[0] = _mm_unpacklo_epi16(low, lowUpper);
+            values[1] = _mm_unpackhi_epi16(low, lowUpper);
+            values[2] = _mm_unpacklo_epi16(high, highUpper);
+            values[3] = _mm_unpackhi_epi16(high, highUpper);
+            __m128i carry = _mm_set1_epi32(int(last));
+            for(int i = 0; i < 4; i++)
+            {
+                __m128i value = _mm_xor_si128(_mm_srli_epi32(values[i], 1),
+                    _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(values[i], _mm_set1_epi32(1))));
+                value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+                value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+                value = _mm_add_epi32(value, carry);
+                carry = _mm_shuffle_epi32(value, 0xff);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 16*i), value);
+            }
+            last = uint32_t(_mm_cvtsi128_si32(carry));
+        }
+        return data;
+    }
+#endif
+}
+
+namespace engine
+{
+    void encodevertices(const void *vertices, size_t count, size_t stride,
+            std::vector<unsigned char> &out)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(vertices);
+        unsigned char last[maxCodecStride];
+        unsigned char planes[maxCodecStride][blockSize];
+        for(size_t first = 0; first < count; first += blockSize)
+        {
+            if(first % codecPageSize == 0)
+            {
+                memset(last, 0, sizeof(last));
+            }
+
+            // A short last block repeats its last vertex, which codes as zero
+            for(size_t i = 0; i < blockSize; i++)
+            {
+                const unsigned char *vertex = bytes + std::min(first + i, count - 1)*stride;
+                for(size_t k = 0; k < stride; k++)
+                {
+                    planes[k][i] = zigzag8((unsigned char)(vertex[k] - last[k]));
+                    last[k] = vertex[k];
+                }
+            }
+            encodeBlock(planes, stride, out);
+        }
+    }
+
+    void encodeindices(const uint32_t *indices, size_t count, size_t indexSize,
+            std::vector<unsigned char> &out)
+    {
+        uint32_t last = 0;
+        unsigned char planes[4][blockSize];
+        for(size_t first = 0; first < count; first += blockSize)
+        {
+            if(first % codecPageSize == 0)
+            {
+                last = 0;
+            }
+            for(size_t i = 0; i < blockSize; i++)
+            {
+                uint32_t index = indices[std::min(first + i, count - 1)];
+                uint32_t value = zigzag32(index - last, indexSize);
+                for(size_t k = 0; k < indexSize; k++)
+                {
+                    planes[k][i] = (unsigned char)(value >> (8*k));
+                }
+                last = index;
+            }
+            encodeBlock(planes, indexSize, out);
+        }
+    }
+
+    bool decodevertices(void *destination, size_t count, size_t stride,
+            const unsigned char *data, size_t size)
+    {
+        if(stride == 0 || stride > maxCodecStride)
+        {
+            return false;
+        }
+        unsigned char *bytes = static_cast<unsigned char *>(destination);
+        const unsigned char *end = data + size;
+        unsigned char last[maxCodecStride];
+        unsigned char tail[blockSize*maxCodecStride];
+        for(size_t block = 0; data && block*blockSize < count; block++)
+        {
+            if(block % blocksPerPage == 0)
+            {
+                memset(last, 0, sizeof(last));
+            }
+
+            size_t first = block*blockSize;
+            if(first + blockSize > count)
+            {
+                data = decodeVertexBlock(data, end, stride, count - first, last, tail);
+                if(data)
+                {
+                    memcpy(bytes + first*stride, tail, (count - first)*stride);
+                }
+            }
+#ifdef MESHCODEC_SSE2
+            else if(stride == 16 || stride == 32)
+            {
+                data = decodeVertexBlockSSE(data, end, stride, last, bytes + first*stride);
+            }
+#endif
+            else
+            {
+                data = decodeVertexBlock(data, end, stride, blockSize, last, bytes + first*stride);
+            }
+        }
+        return data == end;
+    }
+
+    bool decodeindices(void *destination, size_t count, size_t indexSize,
+            const unsigned char *data, size_t size)
+    {
+        if(indexSize != 2 && indexSize != 4)
+        {
+            return false;
+        }
+        unsigned char *bytes = static_cast<unsigned char *>(destination);
+        const unsigned char *end = data + size;
+        uint32_t last = 0;
+        for(size_t block = 0; data && block*blockSize < count; block++)
+        {
+            if(block % blocksPerPage == 0)
+            {
+                last = 0;
+            }
+
+            size_t first = block*blockSize;
+            if(first + blockSize > count)
+            {
+                data = decodeIndexBlock(data, end, indexSize, count - first, last,
+                    bytes + first*indexSize);
+            }
+            else
+            {
+#ifdef MESHCODEC_SSE2
+                data = decodeIndexBlockSSE(data, end, indexSize, last, bytes + first*indexSize);
+#else
+                data = decodeIndexBlock(data, end, indexSize, blockSize, last,
+                    bytes + first*indexSize);
+#endif
+            }
+        }
+        return data == end;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef __MESHCODEC_HPP__
+#define __MESHCODEC_HPP__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/* Lossless compression of vertex and index streams for mesh caches.
+ * Streams are split into pages of codecPageSize elements coded on their
+ * own, and pages into blocks of 16 elements.  Each block is stored as
+ * byte planes, one per byte of an element, with every plane bit-packed
+ * to 0, 2, 4 or 8 bits per element.  Vertices are filtered by coding
+ * each byte as the zigzagged difference from the same byte of the
+ * previous vertex; indices are delta coded against the previous index
+ * and zigzagged before being split into planes.  Decoding uses SSE2
+ * where available and produces the exact bytes that were encoded.
+ */
+namespace engine
+{
+    /* elements per independently coded page; encoding a stream in chunks
+     * of whole pages gives the same bytes as encoding it at once
+     */
+    const size_t codecPageSize = 8192;
+
+    /* largest vertex size the codec accepts */
+    const size_t maxCodecStride = 64;
+
+    /* append count vertices of stride bytes, encoded, to out */
+    void encodevertices(const void *vertices, size_t count, size_t stride,
+            std::vector<unsigned char> &out);
+
+    /* append count indices, encoded as indexSize-byte values, to out */
+    void encodeindices(const uint32_t *indices, size_t count, size_t indexSize,
+            std::vector<unsigned char> &out);
+
+    /* decode exactly size bytes of encoded data into count elements at
+     * destination, returning false if the data is malformed
+     */
+    bool decodevertices(void *destination, size_t count, size_t stride,
+            const unsigned char *data, size_t size);
+    bool decodeindices(void *destination, size_t count, size_t indexSize,
+            const unsigned char *data, size_t size);
+}
+
+#endif  // ifndef __MESHCODEC_HPP__
@@ -0,0 +1,67 @@
+#include "engine/meshindex.hpp"
+#include "engine/hash.hpp"
+
+using namespace engine;
+
+namespace
+{
+    inline uint64_t hashCorner(const glm::ivec3 &corner)
+    {
+        uint64_t key = uint64_t(uint32_t(corner[0])) |
+            (uint64_t(uint32_t(corner[1])) << 32);
+        return mixBits(key ^ mixBits(uint32_t(corner[2])));
+    }
+}
+
+bool engine::indexcorners(const objdata &obj, std::vector<vertex> &vertices,
+        std::vector<uint32_t> &indices)
+{
+    size_t numcorners = obj.corners.size();
+    int numpositions = obj.positions.size();
+    int numuvs = obj.textureUVs.size();
+    int numnormals = obj.normals.size();
+
+    // Open-addressed table of vertex ids, at most half full
+    size_t capacity = 16;
+    while(capacity < numcorners*2)
+    {
+        capacity *= 2;
+    }
+    const uint32_t empty = 0xffffffff;
+    std::vector<uint32_t> table(capacity, empty);
+    std::vector<glm::ivec3> keys;
+
+    vertices.clear();
+    indices.resize(numcorners);
+    for(size_t i = 0; i < numcorners; i++)
+    {
+        const glm::ivec3 &corner = obj.corners[i];
+        if(corner[0] < 0 || corner[0] >= numpositions ||
+                corner[1] >= numuvs || corner[2] >= numnormals)
+        {
+            return false;
+        }
+
+        // Probe linearly until the corner or an empty slot is found
+        size_t slot = hashCorner(corner) & (capacity - 1);
+        while(table[slot] != empty && keys[table[slot]] != corner)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if(table[slot] == empty)
+        {
+            table[slot] = vertices.size();
+            keys.push_back(corner);
+
+            vertex v;
+            v.position = obj.positions[corner[0]];
+            v.uv = corner[1] < 0 ? glm::vec2() : obj.textureUVs[corner[1]];
+            v.normal = corner[2] < 0 ? glm::vec3() : obj.normals[corner[2]];
+            vertices.push_back(v);
+        }
+        indices[i] = table[slot];
+    }
+
+    return true;
+}
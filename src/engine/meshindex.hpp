@@ -0,0 +1,21 @@
+#ifndef __MESHINDEX_HPP__
+#define __MESHINDEX_HPP__
+
+#include <vector>
+#include <stdint.h>
+
+#include "engine/objparser.hpp"
+#include "engine/vertex.hpp"
+
+namespace engine
+{
+    /* Deduplicate the (v, vt, vn) corners of an OBJ file through a hash
+     * table into unique vertices and a triangle list indexing them.
+     * Returns false if a corner references a missing position, UV or
+     * normal.
+     */
+    bool indexcorners(const objdata &obj, std::vector<vertex> &vertices,
+            std::vector<uint32_t> &indices);
+}
+
+#endif  // ifndef __MESHINDEX_HPP__
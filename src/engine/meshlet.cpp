@@ -0,0 +1,165 @@
+#include "engine/meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace engine;
+
+namespace
+{
+    /* Spreads wider than this cannot be culled often enough to matter */
+    const float minConeDot = 0.1f;
+
+    /* Fill in the bounds of the meshlet over indices [begin, end) */
+    void computeBounds(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &indices, size_t begin, size_t end,
+            bool closed, meshlet &m)
+    {
+        glm::vec3 corners[maxMeshletTriangles*3];
+        for(size_t i = begin; i < end; i++)
+        {
+            corners[i - begin] = vertices[indices[i]].position;
+        }
+        meshletbounds(corners, end - begin, closed, m);
+    }
+}
+
+void engine::meshletbounds(const glm::vec3 *corners, size_t count, bool closed,
+        meshlet &m)
+{
+    glm::vec3 lower = corners[0], upper = lower;
+    for(size_t i = 0; i < count; i++)
+    {
+        lower = glm::min(lower, corners[i]);
+        upper = glm::max(upper, corners[i]);
+    }
+    m.center = 0.5f*(lower + upper);
+    m.radius = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        m.radius = std::max(m.radius, glm::length(corners[i] - m.center));
+    }
+
+    // Average the face normals, then find the widest deviation
+    std::vector<glm::vec3> normals;
+    glm::vec3 sum;
+    for(size_t i = 0; i + 2 < count; i += 3)
+    {
+        glm::vec3 n = glm::cross(corners[i + 1] - corners[i],
+                corners[i + 2] - corners[i]);
+        float length = glm::length(n);
+        if(length > 0)
+        {
+            normals.push_back(n/length);
+            sum += n/length;
+        }
+    }
+    m.coneAxis = glm::vec3(0, 0, 1);
+    m.coneCutoff = 1;
+    float length = glm::length(sum);
+    if(!closed || length <= 0)
+    {
+        return;
+    }
+    m.coneAxis = sum/length;
+    float minDot = 1;
+    for(size_t n = 0; n < normals.size(); n++)
+    {
+        minDot = std::min(minDot, glm::dot(normals[n], m.coneAxis));
+    }
+    if(minDot >= minConeDot)
+    {
+        // Sine of the spread: the cosine of the widest angle between the
+        // axis and a view direction that still sees only back faces
+        m.coneCutoff = std::sqrt(1 - minDot*minDot);
+    }
+}
+
+meshletsplitter::meshletsplitter() :
+    vertexCount(0),
+    triangleCount(0)
+{}
+
+void meshletsplitter::reset()
+{
+    vertexCount = 0;
+    triangleCount = 0;
+}
+
+bool meshletsplitter::add(const uint32_t *triangle)
+{
+    // Distinct vertices of the triangle not yet in the meshlet
+    uint32_t fresh[3];
+    unsigned int freshCount = 0;
+    for(int k = 0; k < 3; k++)
+    {
+        bool seen = std::find(used, used + vertexCount, triangle[k]) !=
+            used + vertexCount ||
+            std::find(fresh, fresh + freshCount, triangle[k]) != fresh + freshCount;
+        if(!seen)
+        {
+            fresh[freshCount++] = triangle[k];
+        }
+    }
+
+    // Start over when this triangle would overflow the meshlet
+    bool split = vertexCount + freshCount > maxMeshletVertices ||
+        triangleCount == maxMeshletTriangles;
+    if(split)
+    {
+        reset();
+        freshCount = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            if(std::find(fresh, fresh + freshCount, triangle[k]) == fresh + freshCount)
+            {
+                fresh[freshCount++] = triangle[k];
+            }
+        }
+    }
+    std::copy(fresh, fresh + freshCount, used + vertexCount);
+    vertexCount += freshCount;
+    triangleCount++;
+    return split;
+}
+
+void engine::buildmeshlets(const std::vector<vertex> &vertices,
+        const std::vector<uint32_t> &indices, const std::vector<indexrange> &ranges,
+        bool closed, std::vector<meshlet> &meshlets,
+        std::vector<std::pair<size_t, size_t> > &rangeMeshlets)
+{
+    meshletsplitter splitter;
+    meshlets.clear();
+    rangeMeshlets.clear();
+
+    for(size_t r = 0; r < ranges.size(); r++)
+    {
+        size_t first = meshlets.size();
+        size_t begin = ranges[r].indexOffset;
+        size_t end = begin + ranges[r].indexCount;
+        size_t start = begin;
+        splitter.reset();
+
+        for(size_t i = begin; i < end; i += 3)
+        {
+            if(splitter.add(&indices[i]))
+            {
+                meshlet m;
+                m.indexOffset = start;
+                m.indexCount = i - start;
+                computeBounds(vertices, indices, start, i, closed, m);
+                meshlets.push_back(m);
+                start = i;
+            }
+        }
+        if(start < end)
+        {
+            meshlet m;
+            m.indexOffset = start;
+            m.indexCount = end - start;
+            computeBounds(vertices, indices, start, end, closed, m);
+            meshlets.push_back(m);
+        }
+        rangeMeshlets.push_back(std::make_pair(first, meshlets.size() - first));
+    }
+}
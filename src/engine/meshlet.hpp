@@ -0,0 +1,70 @@
+#ifndef __MESHLET_HPP__
+#define __MESHLET_HPP__
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "includes/glm_include.hpp"
+#include "engine/vertex.hpp"
+#include "engine/meshoptimize.hpp"
+
+namespace engine
+{
+    /* limits of one meshlet, sized for the post-transform cache */
+    const unsigned int maxMeshletVertices = 64;
+    const unsigned int maxMeshletTriangles = 124;
+
+    /* A cluster of nearby triangles, drawn as a contiguous run of its
+     * range's indices, with a bounding sphere and a cone bounding its
+     * triangle normals.  Seen from a point p, every triangle faces away
+     * when dot(center - p, coneAxis) >= coneCutoff*|center - p| + radius;
+     * a coneCutoff of 1 never passes this test.
+     */
+    struct meshlet
+    {
+        glm::vec3 center;
+        float radius;
+        glm::vec3 coneAxis;
+        float coneCutoff;
+        uint32_t indexOffset, indexCount;
+    };
+
+    /* Greedy split of a stream of triangles into meshlets in order */
+    class meshletsplitter
+    {
+        public:
+            meshletsplitter();
+
+            /* start an empty meshlet */
+            void reset();
+
+            /* add a triangle of three indices, returning true if it had to
+             * start a new meshlet to keep the current one within limits
+             */
+            bool add(const uint32_t *triangle);
+
+        private:
+            uint32_t used[maxMeshletVertices];
+            unsigned int vertexCount, triangleCount;
+    };
+
+    /* Fill in the bounding sphere and normal cone of a meshlet from the
+     * positions of its count corners, three per triangle
+     */
+    void meshletbounds(const glm::vec3 *corners, size_t count, bool closed,
+            meshlet &m);
+
+    /* Split each range of an optimized mesh into meshlets in index order.
+     * rangeMeshlets receives the first meshlet and count of every range.
+     * Normal cones are only built for closed meshes, since back faces of
+     * open ones may be visible.
+     */
+    void buildmeshlets(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &indices,
+            const std::vector<indexrange> &ranges, bool closed,
+            std::vector<meshlet> &meshlets,
+            std::vector<std::pair<size_t, size_t> > &rangeMeshlets);
+}
+
+#endif  // ifndef __MESHLET_HPP__
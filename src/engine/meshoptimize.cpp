@@ -0,0 +1,381 @@
+#include "engine/meshoptimize.hpp"
+
+#include <algorithm>
+
+using namespace engine;
+
+namespace
+{
+    /* Vertex to triangle adjacency in compressed row form */
+    struct adjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        adjacency(const std::vector<uint32_t> &indices, size_t vertexCount) :
+            offsets(vertexCount + 1, 0),
+            triangles(indices.size())
+        {
+            for(size_t i = 0; i < indices.size(); i++)
+            {
+                offsets[indices[i] + 1]++;
+            }
+            for(size_t v = 0; v < vertexCount; v++)
+            {
+                offsets[v + 1] += offsets[v];
+            }
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for(size_t i = 0; i < indices.size(); i++)
+            {
+                triangles[fill[indices[i]]++] = i/3;
+            }
+        }
+    };
+
+    /* Push a vertex through a FIFO cache of timestamps, returning 1 on miss */
+    inline unsigned int touchVertex(uint32_t v, std::vector<uint32_t> &cacheTime,
+            uint32_t &time)
+    {
+        if(time - cacheTime[v] > vertexCacheSize)
+        {
+            cacheTime[v] = time++;
+            return 1;
+        }
+        return 0;
+    }
+
+    inline unsigned int touchTriangle(const uint32_t *triangle,
+            std::vector<uint32_t> &cacheTime, uint32_t &time)
+    {
+        return touchVertex(triangle[0], cacheTime, time) +
+            touchVertex(triangle[1], cacheTime, time) +
+            touchVertex(triangle[2], cacheTime, time);
+    }
+
+    /* Pick the next fanning vertex: the candidate that will stay in the
+     * cache longest while its remaining triangles are emitted, falling
+     * back to recently used vertices and then to a scan of all vertices.
+     */
+    int nextVertex(const std::vector<uint32_t> &candidates,
+            const std::vector<uint32_t> &live, const std::vector<uint32_t> &cacheTime,
+            uint32_t time, std::vector<uint32_t> &deadEnds, size_t &cursor)
+    {
+        int best = -1, bestPriority = -1;
+        for(size_t i = 0; i < candidates.size(); i++)
+        {
+            uint32_t v = candidates[i];
+            if(live[v] == 0)
+            {
+                continue;
+            }
+
+            int priority = 0;
+            if(time - cacheTime[v] + 2*live[v] <= vertexCacheSize)
+            {
+                priority = time - cacheTime[v];
+            }
+            if(priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+        if(best >= 0)
+        {
+            return best;
+        }
+
+        while(!deadEnds.empty())
+        {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if(live[v] > 0)
+            {
+                return v;
+            }
+        }
+        while(cursor < live.size())
+        {
+            if(live[cursor] > 0)
+            {
+                return cursor;
+            }
+            cursor++;
+        }
+        return -1;
+    }
+
+    /* Tipsify (Sander, Nehab and Barczak 2007) */
+    void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+    {
+        adjacency adj(indices, vertexCount);
+        std::vector<uint32_t> live(vertexCount);
+        for(size_t v = 0; v < vertexCount; v++)
+        {
+            live[v] = adj.offsets[v + 1] - adj.offsets[v];
+        }
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(indices.size()/3, false);
+        std::vector<uint32_t> deadEnds, candidates, result;
+        result.reserve(indices.size());
+
+        uint32_t time = vertexCacheSize + 1;
+        size_t cursor = 0;
+        int fan = vertexCount > 0 ? 0 : -1;
+        while(fan >= 0)
+        {
+            candidates.clear();
+            for(uint32_t a = adj.offsets[fan]; a < adj.offsets[fan + 1]; a++)
+            {
+                uint32_t t = adj.triangles[a];
+                if(emitted[t])
+                {
+                    continue;
+                }
+                for(int c = 0; c < 3; c++)
+                {
+                    uint32_t v = indices[t*3 + c];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    touchVertex(v, cacheTime, time);
+                }
+                emitted[t] = true;
+            }
+            fan = nextVertex(candidates, live, cacheTime, time, deadEnds, cursor);
+        }
+
+        indices.swap(result);
+    }
+
+    /* Split the cache-optimized triangle order into clusters.  A cluster
+     * starts wherever a triangle misses on all three vertices, and each
+     * of those is split further wherever its running ACMR drops within
+     * threshold of the whole cluster's ACMR.
+     */
+    std::vector<uint32_t> findClusters(const std::vector<uint32_t> &indices,
+            size_t vertexCount, float threshold)
+    {
+        size_t numtriangles = indices.size()/3;
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        uint32_t time = vertexCacheSize + 1;
+
+        std::vector<uint32_t> hard;
+        for(size_t t = 0; t < numtriangles; t++)
+        {
+            if(touchTriangle(&indices[t*3], cacheTime, time) == 3 || t == 0)
+            {
+                hard.push_back(t);
+            }
+        }
+
+        std::vector<uint32_t> soft;
+        for(size_t h = 0; h < hard.size(); h++)
+        {
+            size_t begin = hard[h];
+            size_t end = h + 1 < hard.size() ? hard[h + 1] : numtriangles;
+
+            time += vertexCacheSize + 1;
+            unsigned int misses = 0;
+            for(size_t t = begin; t < end; t++)
+            {
+                misses += touchTriangle(&indices[t*3], cacheTime, time);
+            }
+            float target = threshold*misses/float(end - begin);
+
+            soft.push_back(begin);
+            time += vertexCacheSize + 1;
+            unsigned int runningMisses = 0, runningTriangles = 0;
+            for(size_t t = begin; t < end; t++)
+            {
+                runningMisses += touchTriangle(&indices[t*3], cacheTime, time);
+                runningTriangles++;
+                if(runningMisses <= target*runningTriangles)
+                {
+                    soft.push_back(t + 1);
+                    time += vertexCacheSize + 1;
+                    runningMisses = 0;
+                    runningTriangles = 0;
+                }
+            }
+
+            // Merge the trailing partial cluster into the last full one
+            if(soft.back() != begin)
+            {
+                soft.pop_back();
+            }
+        }
+        return soft;
+    }
+
+    /* Order clusters so those facing away from the mesh centroid, which
+     * are likely to occlude the rest, are drawn first.
+     */
+    void optimizeOverdraw(std::vector<uint32_t> &indices,
+            const std::vector<vertex> &vertices, float threshold)
+    {
+        if(indices.empty())
+        {
+            return;
+        }
+        std::vector<uint32_t> clusters = findClusters(indices, vertices.size(),
+                threshold);
+        size_t numtriangles = indices.size()/3;
+
+        glm::vec3 meshCentroid;
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            meshCentroid += vertices[indices[i]].position;
+        }
+        meshCentroid /= float(indices.size());
+
+        std::vector<std::pair<float, uint32_t> > order(clusters.size());
+        for(size_t c = 0; c < clusters.size(); c++)
+        {
+            size_t begin = clusters[c];
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : numtriangles;
+
+            // Area weighted normal and centroid of the cluster
+            glm::vec3 normal, centroid;
+            float area = 0;
+            for(size_t t = begin; t < end; t++)
+            {
+                glm::vec3 a = vertices[indices[t*3]].position;
+                glm::vec3 b = vertices[indices[t*3 + 1]].position;
+                glm::vec3 d = vertices[indices[t*3 + 2]].position;
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(n);
+                normal += n;
+                centroid += (a + b + d)*(triangleArea/3.0f);
+                area += triangleArea;
+            }
+            if(area > 0)
+            {
+                centroid /= area;
+            }
+            float length = glm::length(normal);
+            if(length > 0)
+            {
+                normal /= length;
+            }
+
+            order[c] = std::make_pair(-glm::dot(centroid - meshCentroid, normal),
+                    uint32_t(c));
+        }
+        std::stable_sort(order.begin(), order.end());
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for(size_t i = 0; i < order.size(); i++)
+        {
+            uint32_t c = order[i].second;
+            size_t begin = clusters[c];
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : numtriangles;
+            result.insert(result.end(), indices.begin() + begin*3,
+                    indices.begin() + end*3);
+        }
+        indices.swap(result);
+    }
+
+    /* Renumber vertices in the order the index list first uses them */
+    void optimizeVertexFetch(std::vector<vertex> &vertices,
+            std::vector<uint32_t> &indices)
+    {
+        const uint32_t unused = 0xffffffff;
+        std::vector<uint32_t> remap(vertices.size(), unused);
+        std::vector<vertex> result;
+        result.reserve(vertices.size());
+
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            uint32_t &target = remap[indices[i]];
+            if(target == unused)
+            {
+                target = result.size();
+                result.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+        vertices.swap(result);
+    }
+}
+
+cachestats engine::analyzevertexcache(const std::vector<uint32_t> &indices,
+        size_t vertexCount)
+{
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = vertexCacheSize + 1;
+    size_t misses = 0;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        misses += touchTriangle(&indices[i], cacheTime, time);
+    }
+
+    cachestats stats;
+    stats.acmr = indices.empty() ? 0 : misses/float(indices.size()/3);
+    stats.atvr = vertexCount == 0 ? 0 : misses/float(vertexCount);
+    return stats;
+}
+
+void engine::sortbygroup(std::vector<uint32_t> &indices,
+        std::vector<uint32_t> &groups)
+{
+    std::vector<uint32_t> order(groups.size());
+    for(size_t t = 0; t < order.size(); t++)
+    {
+        order[t] = t;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return groups[a] < groups[b];
+    });
+
+    std::vector<uint32_t> sortedIndices(indices.size());
+    std::vector<uint32_t> sortedGroups(groups.size());
+    for(size_t t = 0; t < order.size(); t++)
+    {
+        std::copy(indices.begin() + order[t]*3, indices.begin() + order[t]*3 + 3,
+                sortedIndices.begin() + t*3);
+        sortedGroups[t] = groups[order[t]];
+    }
+    indices.swap(sortedIndices);
+    groups.swap(sortedGroups);
+}
+
+void engine::groupranges(const std::vector<uint32_t> &groups, size_t indexOffset,
+        std::vector<indexrange> &ranges)
+{
+    for(size_t t = 0; t < groups.size(); t++)
+    {
+        if(t == 0 || groups[t] != groups[t - 1])
+        {
+            indexrange range = {groups[t], indexOffset + t*3, 0};
+            ranges.push_back(range);
+        }
+        ranges.back().indexCount += 3;
+    }
+}
+
+void engine::optimizeindices(const std::vector<vertex> &vertices,
+        std::vector<uint32_t> &indices, const std::vector<indexrange> &ranges,
+        float threshold)
+{
+    std::vector<uint32_t> part;
+    for(size_t r = 0; r < ranges.size(); r++)
+    {
+        std::vector<uint32_t>::iterator begin = indices.begin() + ranges[r].indexOffset;
+        part.assign(begin, begin + ranges[r].indexCount);
+        optimizeVertexCache(part, vertices.size());
+        optimizeOverdraw(part, vertices, threshold);
+        std::copy(part.begin(), part.end(), begin);
+    }
+}
+
+void engine::optimizemesh(std::vector<vertex> &vertices,
+        std::vector<uint32_t> &indices, const std::vector<indexrange> &ranges,
+        float threshold)
+{
+    optimizeindices(vertices, indices, ranges, threshold);
+    optimizeVertexFetch(vertices, indices);
+}
@@ -0,0 +1,64 @@
+#ifndef __MESHOPTIMIZE_HPP__
+#define __MESHOPTIMIZE_HPP__
+
+#include <vector>
+#include <stdint.h>
+
+#include "engine/vertex.hpp"
+
+namespace engine
+{
+    /* Post-transform cache efficiency of a triangle list, simulated with
+     * a FIFO cache.  acmr is misses per triangle, atvr misses per vertex.
+     */
+    struct cachestats
+    {
+        float acmr, atvr;
+    };
+
+    /* size of the simulated post-transform vertex cache */
+    const unsigned int vertexCacheSize = 16;
+
+    cachestats analyzevertexcache(const std::vector<uint32_t> &indices,
+            size_t vertexCount);
+
+    /* A contiguous run of indices whose triangles share a group, such as
+     * a material
+     */
+    struct indexrange
+    {
+        uint32_t group;
+        size_t indexOffset, indexCount;
+    };
+
+    /* Stably sort triangles by group, given one group per triangle, which
+     * are sorted alongside
+     */
+    void sortbygroup(std::vector<uint32_t> &indices, std::vector<uint32_t> &groups);
+
+    /* Append the runs of equal groups to ranges, numbering indices from
+     * indexOffset
+     */
+    void groupranges(const std::vector<uint32_t> &groups, size_t indexOffset,
+            std::vector<indexrange> &ranges);
+
+    /* Reorder triangles for vertex cache locality (Tipsify), then reorder
+     * clusters of them front to back to reduce overdraw, leaving the
+     * vertices in place.  Triangles never move between ranges, whose
+     * offsets are relative to the start of indices.  threshold bounds how
+     * much the ACMR may worsen to allow smaller, better sorted overdraw
+     * clusters.
+     */
+    void optimizeindices(const std::vector<vertex> &vertices,
+            std::vector<uint32_t> &indices, const std::vector<indexrange> &ranges,
+            float threshold = 1.05f);
+
+    /* Optimize the triangles of each range as optimizeindices does, then
+     * renumber vertices in order of first use for fetch locality.
+     */
+    void optimizemesh(std::vector<vertex> &vertices,
+            std::vector<uint32_t> &indices, const std::vector<indexrange> &ranges,
+            float threshold = 1.05f);
+}
+
+#endif  // ifndef __MESHOPTIMIZE_HPP__
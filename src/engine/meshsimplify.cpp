@@ -0,0 +1,814 @@
+#include "engine/meshsimplify.hpp"
+#include "engine/meshoptimize.hpp"
+#include "engine/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace engine;
+
+namespace
+{
+    /* Sum of squared distances to a set of weighted planes, stored as the
+     * symmetric matrix terms of the quadric form
+     */
+    struct quadric
+    {
+        double a00, a11, a22, a01, a02, a12;
+        double b0, b1, b2, c;
+        double weight;
+
+        quadric() :
+            a00(0), a11(0), a22(0), a01(0), a02(0), a12(0),
+            b0(0), b1(0), b2(0), c(0), weight(0)
+        {}
+
+        /* add the plane n.p + d = 0 with unit normal n */
+        void addPlane(glm::vec3 n, double d, double w)
+        {
+            a00 += w*n.x*n.x;
+            a11 += w*n.y*n.y;
+            a22 += w*n.z*n.z;
+            a01 += w*n.x*n.y;
+            a02 += w*n.x*n.z;
+            a12 += w*n.y*n.z;
+            b0 += w*n.x*d;
+            b1 += w*n.y*d;
+            b2 += w*n.z*d;
+            c += w*d*d;
+            weight += w;
+        }
+
+        void add(const quadric &q)
+        {
+            a00 += q.a00;
+            a11 += q.a11;
+            a22 += q.a22;
+            a01 += q.a01;
+            a02 += q.a02;
+            a12 += q.a12;
+            b0 += q.b0;
+            b1 += q.b1;
+            b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        /* mean squared distance of p to the planes */
+        double error(glm::vec3 p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00*x*x + a11*y*y + a22*z*z +
+                2*(a01*x*y + a02*x*z + a12*y*z) +
+                2*(b0*x + b1*y + b2*z) + c;
+            return weight > 0 ? std::fabs(e)/weight : 0;
+        }
+    };
+
+    struct collapse
+    {
+        float cost;
+        uint32_t from, to;
+    };
+
+    /* sort collapses by cost, keeping the order of equal costs.  Costs
+     * are nonnegative, so they order as their bits do, and are sorted
+     * one byte at a time, least significant first, skipping the bytes all
+     * of them share.
+     */
+    void sortCollapses(std::vector<collapse> &collapses, std::vector<collapse> &sorted)
+    {
+        if(collapses.empty())
+        {
+            return;
+        }
+
+        const int digits = 4, buckets = 256;
+        size_t counts[digits][buckets];
+        memset(counts, 0, sizeof(counts));
+        for(size_t i = 0; i < collapses.size(); i++)
+        {
+            uint32_t bits;
+            memcpy(&bits, &collapses[i].cost, sizeof(bits));
+            for(int d = 0; d < digits; d++)
+            {
+                counts[d][(bits >> (d*8)) & (buckets - 1)]++;
+            }
+        }
+
+        sorted.resize(collapses.size());
+        for(int d = 0; d < digits; d++)
+        {
+            size_t *count = counts[d];
+            uint32_t first;
+            memcpy(&first, &collapses[0].cost, sizeof(first));
+            if(count[(first >> (d*8)) & (buckets - 1)] == collapses.size())
+            {
+                continue;
+            }
+
+            size_t offset = 0;
+            for(int b = 0; b < buckets; b++)
+            {
+                size_t n = count[b];
+                count[b] = offset;
+                offset += n;
+            }
+            for(size_t i = 0; i < collapses.size(); i++)
+            {
+                uint32_t bits;
+                memcpy(&bits, &collapses[i].cost, sizeof(bits));
+                sorted[count[(bits >> (d*8)) & (buckets - 1)]++] = collapses[i];
+            }
+            collapses.swap(sorted);
+        }
+    }
+
+    /* keep a collapse of a position among its two cheapest, in order;
+     * a collapse onto the position itself is an empty slot
+     */
+    inline void keepCheapest(collapse best[2], uint32_t to, float cost)
+    {
+        collapse c = {cost, best[0].from, to};
+        if(best[0].to == best[0].from || cost < best[0].cost)
+        {
+            best[1] = best[0];
+            best[0] = c;
+        }
+        else if(best[1].to == best[1].from || cost < best[1].cost)
+        {
+            best[1] = c;
+        }
+    }
+
+    /* Weight of the perpendicular planes keeping borders in place */
+    const double borderWeight = 10.0;
+
+    /* Levels are not simplified below this many triangles */
+    const size_t minLodTriangles = 32;
+
+    inline uint64_t hashPosition(glm::vec3 p)
+    {
+        // Adding zero turns -0 into 0, which compares equal to it
+        uint32_t bits[3];
+        for(int k = 0; k < 3; k++)
+        {
+            float x = p[k] + 0.0f;
+            memcpy(&bits[k], &x, sizeof(x));
+        }
+        return mixBits((uint64_t(bits[0]) | (uint64_t(bits[1]) << 32)) ^
+                mixBits(bits[2]));
+    }
+
+    /* Id shared by all vertices at the same position, the first of them,
+     * found through a hash table like the one indexcorners uses
+     */
+    void weldPositions(const std::vector<vertex> &vertices,
+            std::vector<uint32_t> &positionId)
+    {
+        // Open-addressed table of vertex ids, at most half full
+        size_t capacity = 16;
+        while(capacity < vertices.size()*2)
+        {
+            capacity *= 2;
+        }
+        const uint32_t empty = 0xffffffff;
+        std::vector<uint32_t> table(capacity, empty);
+
+        positionId.resize(vertices.size());
+        for(size_t v = 0; v < vertices.size(); v++)
+        {
+            glm::vec3 p = vertices[v].position;
+            size_t slot = hashPosition(p) & (capacity - 1);
+            while(table[slot] != empty && vertices[table[slot]].position != p)
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if(table[slot] == empty)
+            {
+                table[slot] = v;
+            }
+            positionId[v] = table[slot];
+        }
+    }
+
+    /* Corners at each position, or vertices of each position, as offsets
+     * into one flat array; at holds the position of each corner
+     */
+    struct adjacency
+    {
+        std::vector<uint32_t> offsets, around, fill, at;
+    };
+
+    /* refill adjacency with the corners of the current triangles, in
+     * increasing order, reusing its storage
+     */
+    void buildCorners(const std::vector<uint32_t> &positionId,
+            const std::vector<uint32_t> &indices, adjacency &adj)
+    {
+        size_t numvertices = positionId.size();
+        adj.offsets.assign(numvertices + 1, 0);
+        adj.at.resize(indices.size());
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            adj.at[i] = positionId[indices[i]];
+            adj.offsets[adj.at[i] + 1]++;
+        }
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            adj.offsets[v + 1] += adj.offsets[v];
+        }
+        adj.around.resize(indices.size());
+        adj.fill.assign(adj.offsets.begin(), adj.offsets.end() - 1);
+        for(size_t i = 0; i < indices.size(); i++)
+        {
+            adj.around[adj.fill[adj.at[i]]++] = i;
+        }
+    }
+
+    /* refill adjacency with the vertices of each position */
+    void buildWedges(const std::vector<uint32_t> &positionId, adjacency &adj)
+    {
+        size_t numvertices = positionId.size();
+        adj.offsets.assign(numvertices + 1, 0);
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            adj.offsets[positionId[v] + 1]++;
+        }
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            adj.offsets[v + 1] += adj.offsets[v];
+        }
+        adj.around.resize(numvertices);
+        adj.fill.assign(adj.offsets.begin(), adj.offsets.end() - 1);
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            adj.around[adj.fill[positionId[v]]++] = v;
+        }
+    }
+
+    /* A triangle side seen from one of its positions, by the corner it
+     * starts from
+     */
+    struct side
+    {
+        uint32_t other, corner;
+    };
+
+    /* An edge from a position to another, with the number of triangle
+     * sides along it and the group of the first, kept in place if it is on
+     * a mesh border or between groups
+     */
+    struct edge
+    {
+        uint32_t other, count, group;
+        bool mixed;
+
+        bool border() const
+        {
+            return count == 1 || mixed;
+        }
+    };
+
+    /* refill sides and edges with those of position a and return whether
+     * a is on a border.  Edges from a position to itself, left by
+     * degenerate triangles, are skipped.
+     */
+    bool findEdges(uint32_t a, const std::vector<uint32_t> &positionId,
+            const std::vector<uint32_t> &indices, const std::vector<uint32_t> &groups,
+            const adjacency &corners, std::vector<side> &sides, std::vector<edge> &edges)
+    {
+        // The side leaving each corner and the side arriving at it
+        sides.clear();
+        for(uint32_t i = corners.offsets[a]; i < corners.offsets[a + 1]; i++)
+        {
+            uint32_t c = corners.around[i];
+            uint32_t next = c - c%3 + (c + 1)%3, previous = c - c%3 + (c + 2)%3;
+            side leaving = {corners.at[next], c};
+            side arriving = {corners.at[previous], previous};
+            sides.push_back(leaving);
+            sides.push_back(arriving);
+        }
+
+        // There are only a few edges, so each side looks for its own
+        edges.clear();
+        for(size_t i = 0; i < sides.size(); i++)
+        {
+            if(sides[i].other == a)
+            {
+                continue;
+            }
+            uint32_t group = groups[sides[i].corner/3];
+            size_t e = 0;
+            while(e < edges.size() && edges[e].other != sides[i].other)
+            {
+                e++;
+            }
+            if(e == edges.size())
+            {
+                edge found = {sides[i].other, 0, group, false};
+                edges.push_back(found);
+            }
+            edges[e].count++;
+            edges[e].mixed = edges[e].mixed || edges[e].group != group;
+        }
+
+        bool border = false;
+        for(size_t e = 0; e < edges.size(); e++)
+        {
+            border = border || edges[e].border();
+        }
+        return border;
+    }
+
+    /* whether every edge from position a is inside a single group, found
+     * without listing the edges: each side leaving a then arrives back at
+     * it from another triangle, so the positions sides leave to and
+     * arrive from have the same sums.  Positions failing the check go
+     * through findEdges.
+     */
+    bool interior(uint32_t a, const std::vector<uint32_t> &groups,
+            const adjacency &corners)
+    {
+        uint32_t first = corners.offsets[a], last = corners.offsets[a + 1];
+        if(first == last)
+        {
+            return false;
+        }
+        uint32_t group = groups[corners.around[first]/3];
+        uint64_t leaving = 0, arriving = 0;
+        uint32_t leavingBits = 0, arrivingBits = 0;
+        for(uint32_t i = first; i < last; i++)
+        {
+            uint32_t c = corners.around[i];
+            uint32_t next = corners.at[c - c%3 + (c + 1)%3];
+            uint32_t previous = corners.at[c - c%3 + (c + 2)%3];
+            if(groups[c/3] != group || next == a || previous == a)
+            {
+                return false;
+            }
+            leaving += next;
+            arriving += previous;
+            leavingBits ^= next;
+            arrivingBits ^= previous;
+        }
+        return leaving == arriving && leavingBits == arrivingBits;
+    }
+
+    /* Working storage of a simplification, refilled in place by every
+     * pass, with the corners of the current triangles at each position,
+     * and the vertices and coordinates of each position, which never
+     * change
+     */
+    struct passbuffers
+    {
+        adjacency corners;
+        std::vector<side> sides;
+        std::vector<edge> edges;
+        std::vector<uint8_t> changed;
+        std::vector<collapse> candidates, sorted;
+        std::vector<uint32_t> target, remap;
+        std::vector<uint32_t> result, resultGroups;
+        std::vector<glm::vec3> positions;
+        adjacency wedges;
+    };
+
+    /* One pass of collapses over the current triangles, cheapest first.
+     * Each is checked against the collapses made before it in the pass;
+     * a position collapsed onto stays put and is not collapsed itself
+     * until the next pass.  Returns the number of triangles removed.
+     */
+    size_t collapsePass(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &positionId, std::vector<uint32_t> &indices,
+            std::vector<uint32_t> &groups, std::vector<quadric> &quadrics,
+            size_t trianglesToRemove, passbuffers &buffers,
+            float &maxError)
+    {
+        size_t numtriangles = indices.size()/3;
+        size_t numvertices = vertices.size();
+
+        // The two cheapest collapses of each position along its edges,
+        // the second for when an earlier collapse takes the first's
+        // target; border positions may only slide along border edges
+        const std::vector<uint32_t> &offsets = buffers.corners.offsets;
+        const std::vector<uint32_t> &around = buffers.corners.around;
+        const std::vector<uint32_t> &at = buffers.corners.at;
+        const std::vector<glm::vec3> &positions = buffers.positions;
+        std::vector<collapse> &candidates = buffers.candidates;
+        candidates.clear();
+        for(uint32_t from = 0; from < numvertices; from++)
+        {
+            collapse best[2] = {{0, from, from}, {0, from, from}};
+
+            // Inside a fan, each side leaving the position reaches a
+            // different neighbour
+            if(interior(from, groups, buffers.corners))
+            {
+                for(uint32_t a = offsets[from]; a < offsets[from + 1]; a++)
+                {
+                    uint32_t c = around[a];
+                    uint32_t other = at[c - c%3 + (c + 1)%3];
+                    quadric q = quadrics[from];
+                    q.add(quadrics[other]);
+                    keepCheapest(best, other, q.error(positions[other]));
+                }
+            }
+            else
+            {
+                bool border = findEdges(from, positionId, indices, groups,
+                        buffers.corners, buffers.sides, buffers.edges);
+                for(size_t e = 0; e < buffers.edges.size(); e++)
+                {
+                    const edge &found = buffers.edges[e];
+                    if(border && !found.border())
+                    {
+                        continue;
+                    }
+                    quadric q = quadrics[from];
+                    q.add(quadrics[found.other]);
+                    keepCheapest(best, found.other,
+                            q.error(positions[found.other]));
+                }
+            }
+            for(int k = 0; k < 2 && best[k].to != from; k++)
+            {
+                candidates.push_back(best[k]);
+            }
+        }
+        sortCollapses(candidates, buffers.sorted);
+
+        // Apply collapses cheapest first until enough triangles are gone
+        std::vector<uint8_t> &changed = buffers.changed;
+        std::vector<uint32_t> &target = buffers.target;
+        changed.assign(numvertices, 0);
+        target.resize(numvertices);
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            target[v] = v;
+        }
+        size_t removed = 0;
+        for(size_t i = 0; i < candidates.size() && removed < trianglesToRemove; i++)
+        {
+            const collapse &c = candidates[i];
+            if(changed[c.from] || target[c.from] != c.from || target[c.to] != c.to)
+            {
+                continue;
+            }
+
+            // Reject collapses that flip or degenerate surviving triangles,
+            // seen with the collapses already made this pass
+            glm::vec3 moved = positions[c.to];
+            bool valid = true;
+            size_t dying = 0;
+            for(uint32_t a = offsets[c.from]; a < offsets[c.from + 1] && valid; a++)
+            {
+                uint32_t t = around[a]/3;
+                uint32_t id[3];
+                glm::vec3 p[3];
+                for(int k = 0; k < 3; k++)
+                {
+                    id[k] = target[at[t*3 + k]];
+                    p[k] = positions[id[k]];
+                }
+                if(id[0] == id[1] || id[1] == id[2] || id[0] == id[2])
+                {
+                    continue;
+                }
+                int corner = around[a]%3;
+                if(id[0] == c.to || id[1] == c.to || id[2] == c.to)
+                {
+                    dying++;
+                    continue;
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                p[corner] = moved;
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+                // The normal may turn by less than about 75 degrees,
+                // compared squared to spare the square roots
+                float turn = glm::dot(before, after);
+                if(turn <= 0 ||
+                        turn*turn <= 0.0625f*glm::dot(before, before)*glm::dot(after, after))
+                {
+                    valid = false;
+                }
+            }
+            if(!valid)
+            {
+                continue;
+            }
+
+            target[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            maxError = std::max(maxError, std::sqrt(c.cost));
+            removed += dying;
+            changed[c.to] = 1;
+        }
+        if(removed == 0)
+        {
+            return 0;
+        }
+
+        // Each vertex of a removed position takes the wedge of the target
+        // position it shares a triangle with, or else the one with the
+        // closest normal and UV
+        std::vector<uint32_t> &remap = buffers.remap;
+        const adjacency &wedges = buffers.wedges;
+        remap.resize(numvertices);
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            remap[v] = v;
+        }
+        for(size_t v = 0; v < numvertices; v++)
+        {
+            uint32_t to = target[positionId[v]];
+            if(to == positionId[v])
+            {
+                continue;
+            }
+
+            int best = -1;
+            for(uint32_t a = offsets[positionId[v]]; a < offsets[positionId[v] + 1]; a++)
+            {
+                uint32_t t = around[a]/3;
+                bool hasWedge = false;
+                for(int k = 0; k < 3; k++)
+                {
+                    hasWedge = hasWedge || indices[t*3 + k] == v;
+                }
+                for(int k = 0; k < 3 && hasWedge; k++)
+                {
+                    if(positionId[indices[t*3 + k]] == to)
+                    {
+                        best = indices[t*3 + k];
+                    }
+                }
+            }
+            if(best < 0)
+            {
+                float bestDistance = 0;
+                for(uint32_t w = wedges.offsets[to]; w < wedges.offsets[to + 1]; w++)
+                {
+                    const vertex &candidate = vertices[wedges.around[w]];
+                    glm::vec3 dn = candidate.normal - vertices[v].normal;
+                    glm::vec2 duv = candidate.uv - vertices[v].uv;
+                    float distance = glm::dot(dn, dn) + glm::dot(duv, duv);
+                    if(best < 0 || distance < bestDistance)
+                    {
+                        best = wedges.around[w];
+                        bestDistance = distance;
+                    }
+                }
+            }
+            remap[v] = best;
+        }
+
+        // Rewrite triangles, dropping those that became degenerate
+        std::vector<uint32_t> &result = buffers.result;
+        std::vector<uint32_t> &resultGroups = buffers.resultGroups;
+        result.clear();
+        resultGroups.clear();
+        for(size_t t = 0; t < numtriangles; t++)
+        {
+            uint32_t a = remap[indices[t*3]];
+            uint32_t b = remap[indices[t*3 + 1]];
+            uint32_t c = remap[indices[t*3 + 2]];
+            if(positionId[a] != positionId[b] && positionId[b] != positionId[c] &&
+                    positionId[a] != positionId[c])
+            {
+                result.push_back(a);
+                result.push_back(b);
+                result.push_back(c);
+                resultGroups.push_back(groups[t]);
+            }
+        }
+        size_t before = indices.size();
+        indices.swap(result);
+        groups.swap(resultGroups);
+        buildCorners(positionId, indices, buffers.corners);
+        return (before - indices.size())/3;
+    }
+
+    /* A mesh being simplified: its current triangles with one group per
+     * triangle, its welded positions and their quadrics, kept from one
+     * level of detail to the next so each level's error is measured
+     * against the full mesh
+     */
+    struct simplification
+    {
+        std::vector<uint32_t> positionId;
+        std::vector<quadric> quadrics;
+        std::vector<uint32_t> indices, groups;
+        passbuffers buffers;
+        float maxError;
+    };
+
+    /* weld the positions of a triangle list and sum the planes of its
+     * triangles into their quadrics
+     */
+    void beginSimplification(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &indices,
+            const std::vector<uint32_t> &indexGroups, simplification &mesh)
+    {
+        std::vector<uint32_t> &positionId = mesh.positionId;
+        weldPositions(vertices, positionId);
+
+        // Triangles already degenerate are dropped first, so collapses
+        // alone make up the triangles removed
+        std::vector<uint32_t> &result = mesh.indices;
+        std::vector<uint32_t> &groups = mesh.groups;
+        result.clear();
+        groups.clear();
+        for(size_t t = 0; t < indices.size()/3; t++)
+        {
+            uint32_t a = positionId[indices[t*3]];
+            uint32_t b = positionId[indices[t*3 + 1]];
+            uint32_t c = positionId[indices[t*3 + 2]];
+            if(a != b && b != c && a != c)
+            {
+                result.insert(result.end(), &indices[t*3], &indices[t*3] + 3);
+                groups.push_back(indexGroups[t]);
+            }
+        }
+
+        // Vertices of each position, fixed for the whole chain
+        passbuffers &buffers = mesh.buffers;
+        buildWedges(positionId, buffers.wedges);
+        buffers.positions.resize(vertices.size());
+        for(size_t v = 0; v < vertices.size(); v++)
+        {
+            buffers.positions[v] = vertices[v].position;
+        }
+
+        // Area weighted face planes, plus perpendicular planes along borders
+        std::vector<quadric> &quadrics = mesh.quadrics;
+        quadrics.assign(vertices.size(), quadric());
+        std::vector<bool> borderSides(result.size(), false);
+        buildCorners(positionId, result, buffers.corners);
+        for(uint32_t a = 0; a < vertices.size(); a++)
+        {
+            if(interior(a, groups, buffers.corners))
+            {
+                continue;
+            }
+            findEdges(a, positionId, result, groups, buffers.corners, buffers.sides,
+                    buffers.edges);
+            for(size_t e = 0; e < buffers.edges.size(); e++)
+            {
+                for(size_t i = 0; i < buffers.sides.size() && buffers.edges[e].border();
+                        i++)
+                {
+                    if(buffers.sides[i].other == buffers.edges[e].other)
+                    {
+                        borderSides[buffers.sides[i].corner] = true;
+                    }
+                }
+            }
+        }
+        for(size_t i = 0; i + 2 < result.size(); i += 3)
+        {
+            glm::vec3 p[3];
+            for(int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[result[i + k]].position;
+            }
+            glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float area = glm::length(n);
+            if(area <= 0)
+            {
+                continue;
+            }
+            n /= area;
+            for(int k = 0; k < 3; k++)
+            {
+                quadrics[positionId[result[i + k]]].addPlane(n, -glm::dot(n, p[0]), area);
+            }
+
+            for(int e = 0; e < 3; e++)
+            {
+                if(!borderSides[i + e])
+                {
+                    continue;
+                }
+                uint32_t a = positionId[result[i + e]];
+                uint32_t b = positionId[result[i + (e + 1)%3]];
+                glm::vec3 edge = p[(e + 1)%3] - p[e];
+                glm::vec3 perpendicular = glm::cross(edge, n);
+                float length = glm::length(perpendicular);
+                if(length <= 0)
+                {
+                    continue;
+                }
+                perpendicular /= length;
+                double d = -glm::dot(perpendicular, p[e]);
+                quadrics[a].addPlane(perpendicular, d, borderWeight*area);
+                quadrics[b].addPlane(perpendicular, d, borderWeight*area);
+            }
+        }
+        mesh.maxError = 0;
+    }
+
+    /* collapse until at most targetIndexCount indices remain or no
+     * collapse is possible
+     */
+    void simplifyTo(const std::vector<vertex> &vertices, size_t targetIndexCount,
+            simplification &mesh)
+    {
+        while(mesh.indices.size() > targetIndexCount)
+        {
+            size_t trianglesToRemove = (mesh.indices.size() - targetIndexCount + 2)/3;
+            if(collapsePass(vertices, mesh.positionId, mesh.indices, mesh.groups,
+                        mesh.quadrics, trianglesToRemove, mesh.buffers,
+                        mesh.maxError) == 0)
+            {
+                break;
+            }
+        }
+    }
+}
+
+float engine::simplifymesh(const std::vector<vertex> &vertices,
+        const std::vector<uint32_t> &indices, std::vector<uint32_t> &groups,
+        size_t targetIndexCount, std::vector<uint32_t> &result)
+{
+    simplification mesh;
+    beginSimplification(vertices, indices, groups, mesh);
+    simplifyTo(vertices, targetIndexCount, mesh);
+    result.swap(mesh.indices);
+    groups.swap(mesh.groups);
+    return mesh.maxError;
+}
+
+bool engine::isclosed(const std::vector<vertex> &vertices,
+        const std::vector<uint32_t> &indices)
+{
+    std::vector<uint32_t> positionId;
+    weldPositions(vertices, positionId);
+
+    // With a single group, border edges are those of only one triangle
+    std::vector<uint32_t> groups(indices.size()/3, 0);
+    passbuffers buffers;
+    buildCorners(positionId, indices, buffers.corners);
+    for(uint32_t a = 0; a < vertices.size(); a++)
+    {
+        if(!interior(a, groups, buffers.corners) &&
+                findEdges(a, positionId, indices, groups, buffers.corners, buffers.sides,
+                    buffers.edges))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void engine::buildlods(const std::vector<vertex> &vertices,
+        std::vector<uint32_t> &indices, std::vector<indexrange> &ranges,
+        std::vector<meshlod> &lods)
+{
+    lods.clear();
+    meshlod full = {0, indices.size(), 0, ranges.size(), 0.0f};
+    lods.push_back(full);
+
+    // One group per triangle of the full mesh
+    std::vector<uint32_t> groups(indices.size()/3);
+    for(size_t r = 0; r < ranges.size(); r++)
+    {
+        std::fill(groups.begin() + ranges[r].indexOffset/3,
+                groups.begin() + (ranges[r].indexOffset + ranges[r].indexCount)/3,
+                ranges[r].group);
+    }
+
+    // Each level carries on simplifying the one before, with the quadrics
+    // of the full mesh, so its error already covers every level above
+    simplification mesh;
+    beginSimplification(vertices, indices, groups, mesh);
+    std::vector<uint32_t> simplified;
+    std::vector<indexrange> levelRanges;
+    size_t previous = indices.size();
+    while(lods.size() < maxLods && previous/3 >= 2*minLodTriangles)
+    {
+        simplifyTo(vertices, previous/2, mesh);
+        if(mesh.indices.empty() || mesh.indices.size() > previous*3/4)
+        {
+            break;
+        }
+
+        // Surviving triangles stay sorted by group
+        simplified = mesh.indices;
+        levelRanges.clear();
+        groupranges(mesh.groups, 0, levelRanges);
+        optimizeindices(vertices, simplified, levelRanges);
+
+        meshlod level = {indices.size(), simplified.size(), ranges.size(),
+            levelRanges.size(), mesh.maxError};
+        for(size_t r = 0; r < levelRanges.size(); r++)
+        {
+            levelRanges[r].indexOffset += indices.size();
+            ranges.push_back(levelRanges[r]);
+        }
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        lods.push_back(level);
+        previous = mesh.indices.size();
+    }
+}
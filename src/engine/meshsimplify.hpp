@@ -0,0 +1,58 @@
+#ifndef __MESHSIMPLIFY_HPP__
+#define __MESHSIMPLIFY_HPP__
+
+#include <vector>
+#include <stdint.h>
+
+#include "engine/vertex.hpp"
+#include "engine/meshoptimize.hpp"
+
+namespace engine
+{
+    /* Simplify a triangle list by quadric error edge collapse until at most
+     * targetIndexCount indices remain or no collapse is possible.  Vertices
+     * are collapsed onto their neighbours, so the result indexes the same
+     * vertex array, and surviving triangles keep their order.  groups holds
+     * one group (e.g. material) per triangle and is filtered to match the
+     * result.  Mesh borders and the edges between groups are preserved and
+     * collapses that would flip a triangle are rejected.  Returns the
+     * largest geometric error introduced, in model units.
+     */
+    float simplifymesh(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &indices, std::vector<uint32_t> &groups,
+            size_t targetIndexCount, std::vector<uint32_t> &result);
+
+    /* whether every edge of a triangle list, with vertices at equal
+     * positions welded, is shared by at least two triangles
+     */
+    bool isclosed(const std::vector<vertex> &vertices,
+            const std::vector<uint32_t> &indices);
+
+    /* most levels of detail kept per mesh, including the full mesh */
+    const unsigned int maxLods = 5;
+
+    /* One level of detail: a range of a mesh's index data drawing the
+     * same vertices with fewer triangles, split into rangeCount group
+     * ranges from firstRange, and the geometric error of the
+     * simplification relative to the full mesh, in model units
+     */
+    struct meshlod
+    {
+        size_t indexOffset, indexCount;
+        size_t firstRange, rangeCount;
+        float error;
+    };
+
+    /* Build a chain of coarser levels for an optimized mesh whose
+     * triangles are sorted by group, given in ranges.  Each level has
+     * about half the triangles of the one before; their indices are
+     * appended to indices and their group ranges to ranges.  Stops early
+     * once simplification stalls.  lods receives every level, starting
+     * with the full mesh.
+     */
+    void buildlods(const std::vector<vertex> &vertices,
+            std::vector<uint32_t> &indices, std::vector<indexrange> &ranges,
+            std::vector<meshlod> &lods);
+}
+
+#endif  // ifndef __MESHSIMPLIFY_HPP__
@@ -0,0 +1,603 @@
+#include "engine/meshstream.hpp"
+#include "engine/meshbuild.hpp"
+#include "engine/objparser.hpp"
+#include "engine/meshlet.hpp"
+#include "engine/spillfile.hpp"
+#include "engine/memoryusage.hpp"
+#include "engine/timer.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+using namespace engine;
+
+namespace
+{
+    /* material of corners before any usemtl, sorting after named ones */
+    const uint32_t noMaterial = 0xffffffff;
+
+    /* face corner as parsed, numbered in file order */
+    struct cornerrecord
+    {
+        int32_t v, vt, vn;
+        uint32_t material;
+        uint64_t corner;
+    };
+
+    /* distinct (v, vt, vn) key and the first corner using it */
+    struct keyrecord
+    {
+        uint64_t first;
+        int32_t v, vt, vn;
+    };
+
+    /* corner and the first corner sharing its key */
+    struct refrecord
+    {
+        uint64_t first, corner;
+        uint32_t material;
+    };
+
+    /* corner resolved to a vertex id */
+    struct indexrecord
+    {
+        uint32_t material, id;
+        uint64_t corner;
+    };
+
+    /* vertex being resolved from its attribute indices */
+    struct vertexrecord
+    {
+        uint32_t id;
+        int32_t v, vt, vn;
+        vertex data;
+    };
+
+    /* edge between two position indices, lower first */
+    struct edgerecord
+    {
+        int32_t a, b;
+    };
+
+    /* vertex at a position of the index stream, and later its position */
+    struct cornerref
+    {
+        uint64_t index;
+        uint32_t id;
+    };
+
+    struct cornerposition
+    {
+        uint64_t index;
+        glm::vec3 position;
+    };
+
+    /* Spill files of one conversion, removed when it ends */
+    class spillfiles
+    {
+        public:
+            spillfiles(std::string prefix) :
+                prefix(prefix),
+                paths()
+            {}
+
+            ~spillfiles()
+            {
+                for(size_t i = 0; i < paths.size(); i++)
+                {
+                    remove(paths[i].c_str());
+                }
+            }
+
+            std::string path(std::string name)
+            {
+                paths.push_back(prefix + "." + name);
+                return paths.back();
+            }
+
+        private:
+            std::string prefix;
+            std::vector<std::string> paths;
+    };
+
+    /* Sort vertex records by one attribute index, then walk the attribute
+     * file alongside them to fill the attribute in; records with a
+     * negative index keep a default value
+     */
+    template <typename A, typename Key, typename Set>
+    bool joinAttribute(std::string path, std::string attributePath,
+            size_t memoryLimit, Key key, Set set)
+    {
+        if(!spillsort<vertexrecord>(path, [&](const vertexrecord &a,
+                        const vertexrecord &b) { return key(a) < key(b); },
+                    memoryLimit))
+        {
+            return false;
+        }
+
+        spillreader<vertexrecord> input;
+        spillreader<A> attributes;
+        spillwriter<vertexrecord> output;
+        std::string joinedPath = path + ".joined";
+        if(!input.open(path) || !attributes.open(attributePath) ||
+                !output.open(joinedPath))
+        {
+            return false;
+        }
+        int64_t next = 0;
+        A value = A();
+        vertexrecord record;
+        while(input.read(record))
+        {
+            for(; next <= key(record); next++)
+            {
+                attributes.read(value);
+            }
+            set(record, key(record) < 0 ? A() : value);
+            output.write(record);
+        }
+        input.close();
+        return output.close() && rename(joinedPath.c_str(), path.c_str()) == 0;
+    }
+}
+
+bool engine::streammesh(std::string objpath, std::string path, bool compact,
+        bool compressed, size_t memoryLimit, meshcache &geometry)
+{
+    timer clock;
+    memoryLimit = std::max(memoryLimit, minStreamMemory);
+
+    // Half the ceiling holds sort buffers, a small part parsed records;
+    // the rest covers read buffers and the parser's working set
+    size_t sortMemory = memoryLimit/2;
+    size_t pieceSize = memoryLimit/16;
+    spillfiles spill(path + ".spill");
+
+    // Pass 1: write attributes, corners and edges out as they are parsed
+    std::string positionPath = spill.path("positions");
+    std::string uvPath = spill.path("uvs");
+    std::string normalPath = spill.path("normals");
+    std::string cornerPath = spill.path("corners");
+    std::string edgePath = spill.path("edges");
+    spillwriter<glm::vec3> positions, normals;
+    spillwriter<glm::vec2> uvs;
+    spillwriter<cornerrecord> corners;
+    spillwriter<edgerecord> edges;
+    if(!positions.open(positionPath) || !uvs.open(uvPath) ||
+            !normals.open(normalPath) || !corners.open(cornerPath) ||
+            !edges.open(edgePath))
+    {
+        std::cout << path << ": could not write spill files\n";
+        return false;
+    }
+
+    std::vector<std::string> materialNames;
+    std::string mtllib;
+    uint32_t currentMaterial = noMaterial;
+    uint64_t cornerCount = 0;
+    bool parsed = parseobjpieces(objpath, pieceSize, [&](const objdata &piece) {
+        for(size_t i = 0; i < piece.positions.size(); i++)
+        {
+            positions.write(piece.positions[i]);
+        }
+        for(size_t i = 0; i < piece.textureUVs.size(); i++)
+        {
+            uvs.write(piece.textureUVs[i]);
+        }
+        for(size_t i = 0; i < piece.normals.size(); i++)
+        {
+            normals.write(piece.normals[i]);
+        }
+
+        size_t run = 0;
+        for(size_t i = 0; i < piece.corners.size(); i++, cornerCount++)
+        {
+            while(run < piece.materialRuns.size() &&
+                    piece.materialRuns[run].firstCorner <= cornerCount)
+            {
+                currentMaterial = piece.materialRuns[run++].material;
+            }
+            const glm::ivec3 &c = piece.corners[i];
+            cornerrecord record = {c[0], c[1], c[2], currentMaterial, cornerCount};
+            corners.write(record);
+
+            // Edges are keyed by position so UV and normal seams still
+            // count as shared
+            if(i % 3 == 2)
+            {
+                for(int k = 0; k < 3; k++)
+                {
+                    int32_t a = piece.corners[i - 2 + k][0];
+                    int32_t b = piece.corners[i - 2 + (k + 1) % 3][0];
+                    edgerecord edge = {std::min(a, b), std::max(a, b)};
+                    edges.write(edge);
+                }
+            }
+        }
+        // Runs starting after the piece's last corner still apply
+        for(; run < piece.materialRuns.size(); run++)
+        {
+            currentMaterial = piece.materialRuns[run].material;
+        }
+        materialNames = piece.materials;
+        mtllib = piece.mtllib;
+        return true;
+    });
+    if(!parsed)
+    {
+        std::cout << objpath << " not found!\n";
+        return false;
+    }
+    int64_t positionCount = positions.count();
+    int64_t uvCount = uvs.count();
+    int64_t normalCount = normals.count();
+    if(!positions.close() || !uvs.close() || !normals.close() ||
+            !corners.close() || !edges.close())
+    {
+        std::cout << path << ": could not write spill files\n";
+        return false;
+    }
+    std::cout << objpath << ": parsed " << cornerCount << " corners in "
+        << clock.milliseconds() << " ms\n";
+
+    // Pass 2: sort corners by key to find distinct vertices and the first
+    // corner using each
+    std::string keyPath = spill.path("keys");
+    std::string refPath = spill.path("refs");
+    {
+        if(!spillsort<cornerrecord>(cornerPath, [](const cornerrecord &a,
+                        const cornerrecord &b) {
+                    return a.v != b.v ? a.v < b.v : a.vt != b.vt ? a.vt < b.vt :
+                        a.vn != b.vn ? a.vn < b.vn : a.corner < b.corner; },
+                    sortMemory))
+        {
+            std::cout << path << ": could not sort corners\n";
+            return false;
+        }
+        spillreader<cornerrecord> input;
+        spillwriter<keyrecord> keys;
+        spillwriter<refrecord> refs;
+        if(!input.open(cornerPath) || !keys.open(keyPath) || !refs.open(refPath))
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        cornerrecord c;
+        keyrecord key = {0, -1, -1, -1};
+        bool any = false;
+        while(input.read(c))
+        {
+            if(c.v < 0 || c.v >= positionCount || c.vt >= uvCount ||
+                    c.vn >= normalCount)
+            {
+                std::cout << objpath << ": face index out of range!\n";
+                return false;
+            }
+            if(!any || c.v != key.v || c.vt != key.vt || c.vn != key.vn)
+            {
+                keyrecord next = {c.corner, c.v, c.vt, c.vn};
+                key = next;
+                keys.write(key);
+                any = true;
+            }
+            refrecord ref = {key.first, c.corner, c.material};
+            refs.write(ref);
+        }
+        if(keys.count() > 0xffffffffULL)
+        {
+            std::cout << objpath << ": too many vertices!\n";
+            return false;
+        }
+        if(!keys.close() || !refs.close())
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        remove(cornerPath.c_str());
+    }
+
+    // Pass 3: number vertices in order of first use, and give every
+    // corner its vertex id
+    std::string indexPath = spill.path("indices");
+    std::string vertexPath = spill.path("vertices");
+    size_t vertexCount = 0;
+    {
+        bool sorted = spillsort<keyrecord>(keyPath, [](const keyrecord &a,
+                    const keyrecord &b) { return a.first < b.first; }, sortMemory) &&
+            spillsort<refrecord>(refPath, [](const refrecord &a,
+                    const refrecord &b) { return a.first < b.first; }, sortMemory);
+        spillreader<keyrecord> keys;
+        spillreader<refrecord> refs;
+        spillwriter<indexrecord> indices;
+        spillwriter<vertexrecord> vertices;
+        if(!sorted || !keys.open(keyPath) || !refs.open(refPath) ||
+                !indices.open(indexPath) || !vertices.open(vertexPath))
+        {
+            std::cout << path << ": could not sort vertices\n";
+            return false;
+        }
+        refrecord ref;
+        keyrecord key = {0, -1, -1, -1};
+        while(refs.read(ref))
+        {
+            // Every key has a corner, so keys advance in step with refs
+            while(vertexCount == 0 || key.first != ref.first)
+            {
+                if(!keys.read(key))
+                {
+                    std::cout << path << ": corrupt spill files\n";
+                    return false;
+                }
+                vertexrecord v = {uint32_t(vertexCount++), key.v, key.vt, key.vn,
+                    vertex()};
+                vertices.write(v);
+            }
+            indexrecord index = {ref.material, uint32_t(vertexCount - 1), ref.corner};
+            indices.write(index);
+        }
+        if(!indices.close() || !vertices.close())
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        remove(keyPath.c_str());
+        remove(refPath.c_str());
+    }
+    std::cout << objpath << ": " << cornerCount << " corners indexed into "
+        << vertexCount << " vertices\n";
+
+    // Pass 4: fetch each attribute in the order of its index, then put
+    // vertices back in id order
+    glm::vec3 lower, upper;
+    bool bounded = false;
+    bool joined = joinAttribute<glm::vec3>(vertexPath, positionPath, sortMemory,
+            [](const vertexrecord &r) { return r.v; },
+            [&](vertexrecord &r, glm::vec3 p) {
+                lower = bounded ? glm::min(lower, p) : p;
+                upper = bounded ? glm::max(upper, p) : p;
+                bounded = true;
+                r.data.position = p;
+            }) &&
+        joinAttribute<glm::vec2>(vertexPath, uvPath, sortMemory,
+            [](const vertexrecord &r) { return r.vt; },
+            [](vertexrecord &r, glm::vec2 uv) { r.data.uv = uv; }) &&
+        joinAttribute<glm::vec3>(vertexPath, normalPath, sortMemory,
+            [](const vertexrecord &r) { return r.vn; },
+            [](vertexrecord &r, glm::vec3 n) { r.data.normal = n; }) &&
+        spillsort<vertexrecord>(vertexPath, [](const vertexrecord &a,
+                    const vertexrecord &b) { return a.id < b.id; }, sortMemory);
+    std::string finalVertexPath = spill.path("final.vertices");
+    {
+        spillreader<vertexrecord> input;
+        spillwriter<vertex> output;
+        if(!joined || !input.open(vertexPath) || !output.open(finalVertexPath))
+        {
+            std::cout << path << ": could not resolve vertices\n";
+            return false;
+        }
+        vertexrecord r;
+        while(input.read(r))
+        {
+            output.write(r.data);
+        }
+        if(!output.close())
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        remove(vertexPath.c_str());
+        remove(positionPath.c_str());
+        remove(uvPath.c_str());
+        remove(normalPath.c_str());
+    }
+
+    // Pass 5: group triangles by material in file order, writing the
+    // index stream and splitting each range into meshlets
+    streamedmesh mesh;
+    mesh.vertexPath = finalVertexPath;
+    mesh.indexPath = spill.path("final.indices");
+    mesh.meshletPath = spill.path("final.meshlets");
+    mesh.vertexCount = vertexCount;
+    mesh.boundsMin = lower;
+    mesh.boundsMax = upper;
+    std::string meshletPath = spill.path("meshlets");
+    std::string cornerRefPath = spill.path("cornerrefs");
+    size_t meshletCount = 0;
+    bool defaultMaterial = false;
+    {
+        bool sorted = spillsort<indexrecord>(indexPath, [](const indexrecord &a,
+                    const indexrecord &b) {
+                return a.material != b.material ? a.material < b.material :
+                    a.corner < b.corner; }, sortMemory);
+        spillreader<indexrecord> input;
+        spillwriter<uint32_t> indices;
+        spillwriter<meshlet> meshlets;
+        spillwriter<cornerref> refs;
+        if(!sorted || !input.open(indexPath) || !indices.open(mesh.indexPath) ||
+                !meshlets.open(meshletPath) || !refs.open(cornerRefPath))
+        {
+            std::cout << path << ": could not sort triangles\n";
+            return false;
+        }
+
+        meshletsplitter splitter;
+        meshlet current = meshlet();
+        indexrecord triangle[3];
+        uint64_t indexCount = 0;
+        while(input.read(triangle[0]) && input.read(triangle[1]) &&
+                input.read(triangle[2]))
+        {
+            uint32_t group = triangle[0].material == noMaterial ?
+                materialNames.size() : triangle[0].material;
+            uint32_t ids[3] = {triangle[0].id, triangle[1].id, triangle[2].id};
+            bool newRange = mesh.ranges.empty() || mesh.ranges.back().group != group;
+            bool split = splitter.add(ids);
+            if(newRange || split)
+            {
+                if(current.indexCount > 0)
+                {
+                    meshlets.write(current);
+                    meshletCount++;
+                }
+                current = meshlet();
+                current.indexOffset = indexCount;
+            }
+            if(newRange)
+            {
+                splitter.reset();
+                splitter.add(ids);
+                indexrange range = {group, size_t(indexCount), 0};
+                mesh.ranges.push_back(range);
+                mesh.rangeMeshlets.push_back(std::make_pair(meshletCount, 0));
+                defaultMaterial = defaultMaterial || triangle[0].material == noMaterial;
+            }
+            for(int k = 0; k < 3; k++)
+            {
+                indices.write(ids[k]);
+                cornerref ref = {indexCount++, ids[k]};
+                refs.write(ref);
+            }
+            current.indexCount += 3;
+            mesh.ranges.back().indexCount += 3;
+            mesh.rangeMeshlets.back().second = meshletCount + 1 -
+                mesh.rangeMeshlets.back().first;
+        }
+        if(current.indexCount > 0)
+        {
+            meshlets.write(current);
+            meshletCount++;
+        }
+        mesh.indexCount = indexCount;
+        if(!indices.close() || !meshlets.close() || !refs.close())
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        remove(indexPath.c_str());
+    }
+
+    // Pass 6: a surface is closed when every edge is shared
+    bool closed = true;
+    {
+        if(!spillsort<edgerecord>(edgePath, [](const edgerecord &a,
+                        const edgerecord &b) {
+                    return a.a != b.a ? a.a < b.a : a.b < b.b; }, sortMemory))
+        {
+            std::cout << path << ": could not sort edges\n";
+            return false;
+        }
+        spillreader<edgerecord> input;
+        input.open(edgePath);
+        edgerecord edge, previous = {-1, -1};
+        size_t uses = 0;
+        while(closed && input.read(edge))
+        {
+            if(edge.a != previous.a || edge.b != previous.b)
+            {
+                closed = previous.a < 0 || uses >= 2;
+                previous = edge;
+                uses = 0;
+            }
+            uses++;
+        }
+        closed = closed && (previous.a < 0 || uses >= 2);
+        input.close();
+        remove(edgePath.c_str());
+    }
+
+    // Pass 7: gather the corner positions of every meshlet in index order
+    // to bound it
+    {
+        bool sorted = spillsort<cornerref>(cornerRefPath, [](const cornerref &a,
+                    const cornerref &b) { return a.id < b.id; }, sortMemory);
+        spillreader<cornerref> refs;
+        spillreader<vertex> vertices;
+        std::string cornerPositionPath = spill.path("cornerpositions");
+        spillwriter<cornerposition> output;
+        if(!sorted || !refs.open(cornerRefPath) || !vertices.open(finalVertexPath) ||
+                !output.open(cornerPositionPath))
+        {
+            std::cout << path << ": could not sort meshlet corners\n";
+            return false;
+        }
+        cornerref ref;
+        vertex v;
+        uint64_t next = 0;
+        while(refs.read(ref))
+        {
+            for(; next <= ref.id; next++)
+            {
+                vertices.read(v);
+            }
+            cornerposition corner = {ref.index, v.position};
+            output.write(corner);
+        }
+        refs.close();
+        remove(cornerRefPath.c_str());
+        if(!output.close() || !spillsort<cornerposition>(cornerPositionPath,
+                    [](const cornerposition &a, const cornerposition &b) {
+                        return a.index < b.index; }, sortMemory))
+        {
+            std::cout << path << ": could not sort meshlet corners\n";
+            return false;
+        }
+
+        spillreader<cornerposition> positions;
+        spillreader<meshlet> input;
+        spillwriter<meshlet> meshlets;
+        if(!positions.open(cornerPositionPath) || !input.open(meshletPath) ||
+                !meshlets.open(mesh.meshletPath))
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+        glm::vec3 corners[maxMeshletTriangles*3];
+        meshlet m;
+        while(input.read(m))
+        {
+            for(size_t i = 0; i < m.indexCount; i++)
+            {
+                cornerposition corner;
+                positions.read(corner);
+                corners[i] = corner.position;
+            }
+            meshletbounds(corners, m.indexCount, closed, m);
+            meshlets.write(m);
+        }
+        mesh.meshletCount = meshlets.count();
+        if(!meshlets.close())
+        {
+            std::cout << path << ": could not write spill files\n";
+            return false;
+        }
+    }
+    std::cout << objpath << ": " << mesh.meshletCount << " meshlets"
+        << (closed ? "" : ", open surface without normal cones") << "\n";
+
+    // Materials and the single level are small enough to keep in memory
+    std::string directory;
+    size_t slash = objpath.find_last_of('/');
+    if(slash != std::string::npos)
+    {
+        directory = objpath.substr(0, slash + 1);
+    }
+    std::string mtlpath = directory + mtllib;
+    if(!loadmaterials(mtlpath, materialNames, mesh.materials))
+    {
+        return false;
+    }
+    if(defaultMaterial)
+    {
+        material fallback = {glm::vec4(1.0f), glm::vec4(0.0f)};
+        mesh.materials.push_back(fallback);
+    }
+    meshlod lod = {0, mesh.indexCount, 0, mesh.ranges.size(), 0.0f};
+    mesh.lods.push_back(lod);
+
+    bool stored = geometry.store(path, objpath, mtlpath, mesh, compact, compressed);
+    std::cout << objpath << ": streamed " << mesh.indexCount/3 << " triangles in "
+        << clock.milliseconds() << " ms within " << (memoryLimit >> 20)
+        << " MB, peak RSS " << (peakResidentBytes() >> 20) << " MB\n";
+    return stored;
+}
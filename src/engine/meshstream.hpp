@@ -0,0 +1,31 @@
+#ifndef __MESHSTREAM_HPP__
+#define __MESHSTREAM_HPP__
+
+#include <string>
+#include <cstddef>
+
+#include "engine/meshcache.hpp"
+
+/* Out-of-core conversion of OBJ files too large to convert in memory.
+ * The OBJ is read a piece at a time and every intermediate array is
+ * spilled to disk, sorted and joined in bounded memory, so peak memory
+ * does not grow with the size of the mesh.
+ */
+namespace engine
+{
+    /* smallest memory ceiling a streaming conversion accepts */
+    const size_t minStreamMemory = 8 << 20;
+
+    /* Convert an OBJ file like buildmesh, using at most about memoryLimit
+     * bytes, and store the result at path through geometry.  Spill files
+     * are written next to path and removed afterwards.  Vertices are
+     * deduplicated and triangles grouped by material and split into
+     * meshlets, but the result is not reordered for the vertex cache and
+     * has a single level of detail.  Returns false if a source is missing
+     * or malformed or a file cannot be written.
+     */
+    bool streammesh(std::string objpath, std::string path, bool compact,
+            bool compressed, size_t memoryLimit, meshcache &geometry);
+}
+
+#endif  // ifndef __MESHSTREAM_HPP__
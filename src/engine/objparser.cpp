@@ -0,0 +1,546 @@
+#include "engine/objparser.hpp"
+#include "engine/mappedfile.hpp"
+#include "engine/timer.hpp"
+#include "engine/parallel.hpp"
+
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+using namespace engine;
+
+namespace
+{
+    const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline void skipBlanks(const char *&p, const char *end)
+    {
+        while(p < end && isBlank(*p))
+        {
+            p++;
+        }
+    }
+
+    inline void skipLine(const char *&p, const char *end)
+    {
+        const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        p = newline ? newline + 1 : end;
+    }
+
+    /* Parse a signed decimal integer, leaving p after its last digit */
+    inline bool parseInt(const char *&p, const char *end, int &value)
+    {
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        if(p == end || !isDigit(*p))
+        {
+            return false;
+        }
+
+        int result = 0;
+        while(p < end && isDigit(*p))
+        {
+            result = result*10 + (*p - '0');
+            p++;
+        }
+        value = negative ? -result : result;
+        return true;
+    }
+
+    /* Parse a decimal float with optional fraction and exponent */
+    inline bool parseFloat(const char *&p, const char *end, float &value)
+    {
+        skipBlanks(p, end);
+
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        // Accumulate up to 19 significant digits, tracking the decimal shift
+        unsigned long long mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        while(p < end && isDigit(*p))
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa*10 + (*p - '0');
+                if(mantissa)
+                {
+                    digits++;
+                }
+            }
+            else
+            {
+                exponent++;
+            }
+            any = true;
+            p++;
+        }
+        if(p < end && *p == '.')
+        {
+            p++;
+            while(p < end && isDigit(*p))
+            {
+                if(digits < 19)
+                {
+                    mantissa = mantissa*10 + (*p - '0');
+                    if(mantissa)
+                    {
+                        digits++;
+                    }
+                    exponent--;
+                }
+                any = true;
+                p++;
+            }
+        }
+        if(!any)
+        {
+            return false;
+        }
+
+        if(p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            int e;
+            if(parseInt(q, end, e))
+            {
+                exponent += e;
+                p = q;
+            }
+        }
+
+        double result = double(mantissa);
+        if(exponent < 0 && exponent >= -22)
+        {
+            result /= powersOf10[-exponent];
+        }
+        else if(exponent > 0 && exponent <= 22)
+        {
+            result *= powersOf10[exponent];
+        }
+        else if(exponent != 0)
+        {
+            result *= std::pow(10.0, exponent);
+        }
+        value = float(negative ? -result : result);
+        return true;
+    }
+
+    /* Per-thread parse state for one newline-aligned range of the file.
+     * Negative OBJ indices are resolved against the chunk's own counts,
+     * and the components they were stored in are listed in relative so
+     * they can be shifted once the counts of earlier chunks are known.
+     */
+    struct chunk
+    {
+        objdata obj;
+        std::vector<size_t> relative;
+    };
+
+    inline int resolveComponent(int index, size_t count, chunk &c,
+            int component)
+    {
+        if(index > 0)
+        {
+            return index - 1;
+        }
+        c.relative.push_back(c.obj.corners.size()*3 + component);
+        return int(count) + index;
+    }
+
+    /* Parse one v, v/vt, v//vn or v/vt/vn face corner */
+    inline bool parseCorner(const char *&p, const char *end, chunk &c,
+            glm::ivec3 &corner)
+    {
+        int index;
+        if(!parseInt(p, end, index))
+        {
+            return false;
+        }
+        corner = glm::ivec3(resolveComponent(index, c.obj.positions.size(), c, 0),
+                -1, -1);
+
+        if(p < end && *p == '/')
+        {
+            p++;
+            if(parseInt(p, end, index))
+            {
+                corner[1] = resolveComponent(index, c.obj.textureUVs.size(), c, 1);
+            }
+            if(p < end && *p == '/')
+            {
+                p++;
+                if(parseInt(p, end, index))
+                {
+                    corner[2] = resolveComponent(index, c.obj.normals.size(), c, 2);
+                }
+            }
+        }
+        return true;
+    }
+
+    inline void emitCorner(chunk &c, const glm::ivec3 &corner,
+            const std::vector<size_t> &components)
+    {
+        for(size_t i = 0; i < components.size(); i++)
+        {
+            c.relative.push_back(c.obj.corners.size()*3 + components[i]);
+        }
+        c.obj.corners.push_back(corner);
+    }
+
+    /* Parse a face, triangulating polygons as a fan around the first corner.
+     * Relative indices are recorded against the corner slot they will
+     * occupy, so a fan corner that is emitted more than once is recorded
+     * for each copy.
+     */
+    void parseFace(const char *&p, const char *end, chunk &c)
+    {
+        glm::ivec3 first, previous, corner;
+        std::vector<size_t> firstRelative, previousRelative;
+        int count = 0;
+
+        skipBlanks(p, end);
+        while(p < end && *p != '\n')
+        {
+            size_t marker = c.relative.size();
+            if(!parseCorner(p, end, c, corner))
+            {
+                break;
+            }
+
+            // Take this corner's relative components back out of the list
+            std::vector<size_t> cornerRelative;
+            for(size_t i = marker; i < c.relative.size(); i++)
+            {
+                cornerRelative.push_back(c.relative[i] % 3);
+            }
+            c.relative.resize(marker);
+
+            if(count == 0)
+            {
+                first = corner;
+                firstRelative = cornerRelative;
+            }
+            else if(count >= 2)
+            {
+                emitCorner(c, first, firstRelative);
+                emitCorner(c, previous, previousRelative);
+                emitCorner(c, corner, cornerRelative);
+            }
+            previous = corner;
+            previousRelative.swap(cornerRelative);
+            count++;
+            skipBlanks(p, end);
+        }
+    }
+
+    inline bool hasKeyword(const char *p, const char *end, const char *keyword,
+            size_t length)
+    {
+        return size_t(end - p) > length && memcmp(p, keyword, length) == 0 &&
+            isBlank(p[length]);
+    }
+
+    /* Parse a name up to the next blank or line end */
+    inline std::string parseName(const char *&p, const char *end)
+    {
+        skipBlanks(p, end);
+        const char *name = p;
+        while(p < end && !isBlank(*p) && *p != '\n')
+        {
+            p++;
+        }
+        return std::string(name, p);
+    }
+
+    /* Start a material run at the next corner, numbering new names */
+    void useMaterial(const std::string &name, objdata &obj)
+    {
+        unsigned int id = std::find(obj.materials.begin(), obj.materials.end(),
+                name) - obj.materials.begin();
+        if(id == obj.materials.size())
+        {
+            obj.materials.push_back(name);
+        }
+        materialrun run = {obj.corners.size(), id};
+        if(!obj.materialRuns.empty() &&
+                obj.materialRuns.back().firstCorner == run.firstCorner)
+        {
+            obj.materialRuns.back() = run;
+        }
+        else
+        {
+            obj.materialRuns.push_back(run);
+        }
+    }
+
+    /* Tokenize the records in [p, end), which starts at a line boundary */
+    void parseChunk(const char *p, const char *end, chunk &c)
+    {
+        objdata &obj = c.obj;
+        while(p < end)
+        {
+            skipBlanks(p, end);
+            if(p == end)
+            {
+                break;
+            }
+
+            if(hasKeyword(p, end, "v", 1))
+            {
+                p += 2;
+                glm::vec3 position;
+                parseFloat(p, end, position.x);
+                parseFloat(p, end, position.y);
+                parseFloat(p, end, position.z);
+                obj.positions.push_back(position);
+            }
+            else if(hasKeyword(p, end, "vt", 2))
+            {
+                p += 3;
+                glm::vec2 uv;
+                parseFloat(p, end, uv.x);
+                parseFloat(p, end, uv.y);
+                obj.textureUVs.push_back(uv);
+            }
+            else if(hasKeyword(p, end, "vn", 2))
+            {
+                p += 3;
+                glm::vec3 normal;
+                parseFloat(p, end, normal.x);
+                parseFloat(p, end, normal.y);
+                parseFloat(p, end, normal.z);
+                obj.normals.push_back(normal);
+            }
+            else if(hasKeyword(p, end, "f", 1))
+            {
+                p += 2;
+                parseFace(p, end, c);
+            }
+            else if(hasKeyword(p, end, "usemtl", 6))
+            {
+                p += 7;
+                useMaterial(parseName(p, end), obj);
+            }
+            else if(hasKeyword(p, end, "mtllib", 6) && obj.mtllib.empty())
+            {
+                p += 7;
+                obj.mtllib = parseName(p, end);
+            }
+
+            skipLine(p, end);
+        }
+    }
+
+    /* Append the material runs of a chunk starting at cornerOffset to
+     * runs, renumbering their materials into the merged list of names
+     */
+    void mergeRuns(const objdata &part, size_t cornerOffset,
+            std::vector<std::string> &materials, std::vector<materialrun> &runs)
+    {
+        // Runs continue across chunks, so only renumber their materials
+        for(size_t r = 0; r < part.materialRuns.size(); r++)
+        {
+            materialrun run = part.materialRuns[r];
+            const std::string &name = part.materials[run.material];
+            run.firstCorner += cornerOffset;
+            run.material = std::find(materials.begin(), materials.end(), name) -
+                materials.begin();
+            if(run.material == materials.size())
+            {
+                materials.push_back(name);
+            }
+            runs.push_back(run);
+        }
+    }
+
+    /* Shift the relative indices of a chunk by the attribute counts of
+     * all chunks before it
+     */
+    void shiftRelative(chunk &c, const glm::ivec3 &attributeOffset)
+    {
+        std::vector<glm::ivec3> &corners = c.obj.corners;
+        for(size_t r = 0; r < c.relative.size(); r++)
+        {
+            size_t component = c.relative[r] % 3;
+            corners[c.relative[r]/3][component] += attributeOffset[component];
+        }
+    }
+
+    /* Copy src into dst starting at offset */
+    template <typename T>
+    void place(const std::vector<T> &src, std::vector<T> &dst, size_t offset)
+    {
+        std::copy(src.begin(), src.end(), dst.begin() + offset);
+    }
+}
+
+unsigned int engine::parserThreads = 0;
+
+bool engine::parseobj(std::string filepath, objdata &obj)
+{
+    timer clock;
+
+    mappedfile file;
+    if(!file.open(filepath))
+    {
+        return false;
+    }
+
+    // Split the file into newline-aligned chunks of at least minChunkSize
+    const size_t minChunkSize = 1 << 20;
+    size_t numchunks = resolveThreads(parserThreads);
+    if(numchunks > file.size()/minChunkSize)
+    {
+        numchunks = file.size()/minChunkSize;
+    }
+    if(numchunks == 0)
+    {
+        numchunks = 1;
+    }
+
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+    std::vector<const char*> bounds(numchunks + 1, end);
+    bounds[0] = begin;
+    for(size_t i = 1; i < numchunks; i++)
+    {
+        const char *p = std::max(begin + file.size()*i/numchunks, bounds[i - 1]);
+        skipLine(p, end);
+        bounds[i] = p;
+    }
+
+    // Parse every chunk into its own arrays
+    std::vector<chunk> chunks(numchunks);
+    parallelInvoke(numchunks, [&](size_t i) {
+        parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    if(numchunks == 1)
+    {
+        obj.positions.swap(chunks[0].obj.positions);
+        obj.textureUVs.swap(chunks[0].obj.textureUVs);
+        obj.normals.swap(chunks[0].obj.normals);
+        obj.corners.swap(chunks[0].obj.corners);
+        obj.materials.swap(chunks[0].obj.materials);
+        obj.materialRuns.swap(chunks[0].obj.materialRuns);
+        obj.mtllib = chunks[0].obj.mtllib;
+    }
+    else
+    {
+        // Prefix sums give each chunk's offset into the merged arrays
+        std::vector<glm::ivec3> attributeOffsets(numchunks);
+        std::vector<size_t> cornerOffsets(numchunks);
+        glm::ivec3 attributeCount;
+        size_t cornerCount = 0;
+        for(size_t i = 0; i < numchunks; i++)
+        {
+            const objdata &part = chunks[i].obj;
+            attributeOffsets[i] = attributeCount;
+            cornerOffsets[i] = cornerCount;
+            attributeCount += glm::ivec3(part.positions.size(),
+                    part.textureUVs.size(), part.normals.size());
+            cornerCount += part.corners.size();
+            if(obj.mtllib.empty())
+            {
+                obj.mtllib = part.mtllib;
+            }
+            mergeRuns(part, cornerOffsets[i], obj.materials, obj.materialRuns);
+        }
+
+        obj.positions.resize(attributeCount[0]);
+        obj.textureUVs.resize(attributeCount[1]);
+        obj.normals.resize(attributeCount[2]);
+        obj.corners.resize(cornerCount);
+
+        // Shift relative indices and merge every chunk into place
+        parallelInvoke(numchunks, [&](size_t i) {
+            chunk &c = chunks[i];
+            shiftRelative(c, attributeOffsets[i]);
+
+            place(c.obj.positions, obj.positions, attributeOffsets[i][0]);
+            place(c.obj.textureUVs, obj.textureUVs, attributeOffsets[i][1]);
+            place(c.obj.normals, obj.normals, attributeOffsets[i][2]);
+            place(c.obj.corners, obj.corners, cornerOffsets[i]);
+        });
+    }
+
+    double megabytes = file.size()/(1024.0*1024.0);
+    double seconds = clock.seconds();
+    std::cout << filepath << ": parsed " << megabytes << " MB in "
+        << seconds*1000.0 << " ms (" << megabytes/seconds << " MB/s, "
+        << numchunks << " threads)\n";
+
+    return true;
+}
+
+bool engine::parseobjpieces(std::string filepath, size_t pieceSize,
+        const std::function<bool(const objdata&)> &consume)
+{
+    mappedfile file;
+    if(!file.open(filepath))
+    {
+        return false;
+    }
+
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+    glm::ivec3 attributeCount;
+    size_t cornerCount = 0;
+    std::vector<std::string> materials;
+    std::string mtllib;
+    for(const char *p = begin; p < end;)
+    {
+        const char *next = p + std::min(pieceSize, size_t(end - p));
+        skipLine(next, end);
+
+        // Parse the piece alone, then make it refer to the whole file
+        chunk c;
+        parseChunk(p, next, c);
+        shiftRelative(c, attributeCount);
+        std::vector<materialrun> runs;
+        mergeRuns(c.obj, cornerCount, materials, runs);
+        c.obj.materialRuns.swap(runs);
+        c.obj.materials = materials;
+        if(mtllib.empty())
+        {
+            mtllib = c.obj.mtllib;
+        }
+        c.obj.mtllib = mtllib;
+
+        attributeCount += glm::ivec3(c.obj.positions.size(),
+                c.obj.textureUVs.size(), c.obj.normals.size());
+        cornerCount += c.obj.corners.size();
+        if(!consume(c.obj))
+        {
+            return false;
+        }
+        file.release(p - begin, next - p);
+        p = next;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef __OBJPARSER_HPP__
+#define __OBJPARSER_HPP__
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "includes/glm_include.hpp"
+
+namespace engine
+{
+    /* Corners from firstCorner up to the next run use one material */
+    struct materialrun
+    {
+        size_t firstCorner;
+        unsigned int material;
+    };
+
+    /* Raw records of an OBJ file.  Each face is triangulated and stored
+     * as three corners of zero-based (v, vt, vn) indices, with -1 marking
+     * an attribute the corner does not reference.  usemtl records start
+     * material runs indexing materials, which lists names in order of
+     * first use; corners before the first run have no material.
+     */
+    struct objdata
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> textureUVs;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::ivec3> corners;
+        std::vector<std::string> materials;
+        std::vector<materialrun> materialRuns;
+        std::string mtllib;
+    };
+
+    /* Number of threads used to parse large OBJ files, 0 for all cores */
+    extern unsigned int parserThreads;
+
+    /* Memory-map an OBJ file and tokenize v, vt, vn, f, usemtl and mtllib
+     * records in place, splitting large files into chunks parsed in parallel.
+     * Returns false if the file cannot be opened.
+     */
+    bool parseobj(std::string filepath, objdata &obj);
+
+    /* Parse an OBJ file one newline-aligned piece of about pieceSize bytes
+     * at a time, for files whose records do not fit in memory, releasing
+     * each piece of the mapping once parsed.  consume receives the records
+     * of every piece in order: attributes are those the piece defines,
+     * while corner indices and material runs refer to the whole file as
+     * parseobj would return them, and materials names every material seen
+     * so far.  Returns false if the file cannot be opened or consume
+     * returns false.
+     */
+    bool parseobjpieces(std::string filepath, size_t pieceSize,
+            const std::function<bool(const objdata&)> &consume);
+}
+
+#endif  // ifndef __OBJPARSER_HPP__
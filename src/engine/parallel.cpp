@@ -0,0 +1,82 @@
+#include "engine/parallel.hpp"
+
+using namespace engine;
+
+workerpool::workerpool(unsigned int threads) :
+    workers(),
+    jobs(),
+    lock(),
+    wake(),
+    idle(),
+    running(0),
+    stopping(false)
+{
+    threads = resolveThreads(threads);
+    for(unsigned int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&workerpool::run, this));
+    }
+}
+
+workerpool::~workerpool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+void workerpool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(job);
+    }
+    wake.notify_one();
+}
+
+void workerpool::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while(!jobs.empty() || running > 0)
+    {
+        idle.wait(guard);
+    }
+}
+
+void workerpool::run()
+{
+    while(true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping && jobs.empty())
+            {
+                wake.wait(guard);
+            }
+            if(stopping)
+            {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+            running++;
+        }
+        job();
+
+        std::lock_guard<std::mutex> guard(lock);
+        running--;
+        if(jobs.empty() && running == 0)
+        {
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef __PARALLEL_HPP__
+#define __PARALLEL_HPP__
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+/* Helpers for splitting loader work across threads
+ */
+namespace engine
+{
+    /* number of worker threads to use when 0 (all cores) is requested */
+    inline unsigned int resolveThreads(unsigned int threads)
+    {
+        if(threads == 0)
+        {
+            threads = std::thread::hardware_concurrency();
+        }
+        return threads == 0 ? 1 : threads;
+    }
+
+    /* Call f(i) for every i in [0, count) with one thread per index,
+     * running the last index on the calling thread.
+     */
+    template <typename F>
+    void parallelInvoke(size_t count, F f)
+    {
+        std::vector<std::thread> workers;
+        for(size_t i = 0; i + 1 < count; i++)
+        {
+            workers.push_back(std::thread(f, i));
+        }
+        if(count > 0)
+        {
+            f(count - 1);
+        }
+        for(size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+        }
+    }
+
+    /* Split [0, count) into contiguous ranges and call f(begin, end)
+     * for each range on its own thread.
+     */
+    template <typename F>
+    void parallelFor(size_t count, unsigned int threads, F f)
+    {
+        size_t ranges = resolveThreads(threads);
+        if(ranges > count)
+        {
+            ranges = count;
+        }
+        parallelInvoke(ranges, [&](size_t i) {
+            f(count*i/ranges, count*(i + 1)/ranges);
+        });
+    }
+
+    /* Fixed set of background threads running queued jobs in order.
+     * Jobs still queued when the pool is destroyed are discarded.
+     */
+    class workerpool
+    {
+        public:
+            workerpool(unsigned int threads);
+            ~workerpool();
+
+            void submit(std::function<void()> job);
+
+            /* block until every submitted job has finished */
+            void wait();
+
+        private:
+            std::vector<std::thread> workers;
+            std::deque<std::function<void()> > jobs;
+            std::mutex lock;
+            std::condition_variable wake, idle;
+            size_t running;
+            bool stopping;
+
+            void run();
+
+            /* pools are not copyable */
+            workerpool(const workerpool& p);
+            workerpool& operator=(const workerpool& p);
+    };
+}
+
+#endif  // ifndef __PARALLEL_HPP__
@@ -0,0 +1,258 @@
+#include "engine/renderqueue.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+// Bits of each field of a key, from the most significant: pass, program,
+// vertex array, material and depth
+#define PASS_BITS 12
+#define PROGRAM_BITS 6
+#define VERTEX_ARRAY_BITS 6
+#define MATERIAL_BITS 16
+#define DEPTH_BITS 24
+
+// Passes a frame may record, as many as keys can number
+#define MAX_PASSES (1 << PASS_BITS)
+
+// Keys are sorted one byte at a time
+#define RADIX_BITS 8
+
+using namespace engine;
+
+namespace
+{
+    // Fields too large for their bits share the largest value; programs
+    // and vertex arrays are bound from the packet, so this only loosens
+    // the sort
+    uint64_t field(uint64_t value, int bits)
+    {
+        return std::min(value, (uint64_t(1) << bits) - 1);
+    }
+}
+
+queuestats::queuestats() :
+    packets(0),
+    passes(0),
+    refusedPasses(0),
+    programBinds(0),
+    vertexArrayBinds(0),
+    skippedBinds(0),
+    draws(0)
+{}
+
+renderqueue::renderqueue() :
+    stats(),
+    passes(),
+    packets(),
+    refusedPasses(0),
+    keys(),
+    sorted(),
+    programs(),
+    vertexArrays(),
+    run(),
+    boundProgram(0),
+    boundVertexArray(0)
+{}
+
+void renderqueue::clear()
+{
+    passes.clear();
+    packets.clear();
+    refusedPasses = 0;
+    keys.clear();
+    programs.clear();
+    vertexArrays.clear();
+}
+
+bool renderqueue::beginPass(const program &p, std::function<void()> setup)
+{
+    // Keys would give a later pass the number of the last, sorting its
+    // packets into that pass, so it is refused; the passes after it are
+    // refused too, since their packets could not follow it
+    if(passes.size() == MAX_PASSES)
+    {
+        refusedPasses++;
+        return false;
+    }
+
+    size_t programIndex = std::find(programs.begin(), programs.end(), p.id()) -
+        programs.begin();
+    if(programIndex == programs.size())
+    {
+        programs.push_back(p.id());
+    }
+    pass recorded = {p.id(), programIndex, setup};
+    passes.push_back(recorded);
+    return true;
+}
+
+void renderqueue::addDraw(geometrypool &pool, GLuint materialIndex, float depth,
+        const drawcommand &command)
+{
+    // Keys start with the pass, so a packet cannot be ordered without one
+    if(passes.empty() || refusedPasses > 0)
+    {
+        return;
+    }
+    packet recorded = {&pool, pool.vertexArrayId(), command};
+    keys.push_back(std::make_pair(makeKey(recorded.vertexArray, materialIndex, depth),
+                uint32_t(packets.size())));
+    packets.push_back(recorded);
+}
+
+void renderqueue::addArrays(GLuint vertexArray, GLuint count)
+{
+    if(passes.empty() || refusedPasses > 0)
+    {
+        return;
+    }
+    packet recorded = {0, vertexArray, drawcommand()};
+    recorded.command.count = count;
+    keys.push_back(std::make_pair(makeKey(vertexArray, 0, 0),
+                uint32_t(packets.size())));
+    packets.push_back(recorded);
+}
+
+void renderqueue::submit(streamring &ring)
+{
+    stats = queuestats();
+    stats.packets = packets.size();
+    stats.passes = passes.size();
+    stats.refusedPasses = refusedPasses;
+
+    // Instances of every pool are streamed once for all passes drawing
+    // them, before any vertex array is bound
+    geometrypool::prepareAll(ring);
+    sortKeys();
+
+    // Other code binds programs and vertex arrays between frames, so the
+    // first of each is always bound
+    boundProgram = 0;
+    boundVertexArray = 0;
+
+    size_t next = 0;
+    for(size_t p = 0; p < passes.size(); p++)
+    {
+        // Passes are set up even without packets, since later passes may
+        // read what they clear
+        bindProgram(passes[p].program);
+        passes[p].setup();
+
+        while(next < keys.size() &&
+                keys[next].first >> (64 - PASS_BITS) == field(p, PASS_BITS))
+        {
+            const packet &first = packets[keys[next].second];
+            bindVertexArray(first.vertexArray);
+            if(!first.pool)
+            {
+                glDrawArrays(GL_TRIANGLES, 0, first.command.count);
+                stats.draws++;
+                next++;
+                continue;
+            }
+
+            // Adjacent packets of the same pool are drawn with one call,
+            // whatever their materials and depths
+            run.clear();
+            while(next < keys.size() &&
+                    keys[next].first >> (64 - PASS_BITS) == field(p, PASS_BITS) &&
+                    packets[keys[next].second].pool == first.pool)
+            {
+                run.push_back(packets[keys[next].second].command);
+                next++;
+            }
+            stats.draws += first.pool->draw(&run[0], run.size(), ring);
+        }
+    }
+    glBindVertexArray(0);
+}
+
+uint64_t renderqueue::makeKey(GLuint vertexArray, GLuint materialIndex, float depth)
+{
+    size_t vertexArrayIndex = std::find(vertexArrays.begin(), vertexArrays.end(),
+            vertexArray) - vertexArrays.begin();
+    if(vertexArrayIndex == vertexArrays.size())
+    {
+        vertexArrays.push_back(vertexArray);
+    }
+
+    // Nonnegative floats order as their bits do, so the top bits of the
+    // depth below the sign bit keep its order
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    uint64_t key = field(passes.size() - 1, PASS_BITS);
+    key = key << PROGRAM_BITS | field(passes.back().programIndex, PROGRAM_BITS);
+    key = key << VERTEX_ARRAY_BITS | field(vertexArrayIndex, VERTEX_ARRAY_BITS);
+    key = key << MATERIAL_BITS | field(materialIndex, MATERIAL_BITS);
+    key = key << DEPTH_BITS | depthBits >> (31 - DEPTH_BITS);
+    return key;
+}
+
+void renderqueue::sortKeys()
+{
+    // Least significant digit first, keeping the order of equal digits,
+    // so packets with equal keys stay in recording order.  Counts of
+    // every digit are taken in one sweep, and digits all keys share are
+    // skipped, which leaves few sweeps for the few passes and materials
+    // of a frame.
+    const int digits = 64/RADIX_BITS, buckets = 1 << RADIX_BITS;
+    size_t counts[digits][buckets];
+    memset(counts, 0, sizeof(counts));
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        for(int d = 0; d < digits; d++)
+        {
+            counts[d][(keys[i].first >> (d*RADIX_BITS)) & (buckets - 1)]++;
+        }
+    }
+
+    sorted.resize(keys.size());
+    for(int d = 0; d < digits; d++)
+    {
+        size_t *count = counts[d];
+        if(keys.empty() ||
+                count[(keys[0].first >> (d*RADIX_BITS)) & (buckets - 1)] == keys.size())
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for(int b = 0; b < buckets; b++)
+        {
+            size_t n = count[b];
+            count[b] = offset;
+            offset += n;
+        }
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            sorted[count[(keys[i].first >> (d*RADIX_BITS)) & (buckets - 1)]++] = keys[i];
+        }
+        keys.swap(sorted);
+    }
+}
+
+void renderqueue::bindProgram(GLuint id)
+{
+    if(id == boundProgram)
+    {
+        stats.skippedBinds++;
+        return;
+    }
+    glUseProgram(id);
+    boundProgram = id;
+    stats.programBinds++;
+}
+
+void renderqueue::bindVertexArray(GLuint id)
+{
+    if(id == boundVertexArray)
+    {
+        stats.skippedBinds++;
+        return;
+    }
+    glBindVertexArray(id);
+    boundVertexArray = id;
+    stats.vertexArrayBinds++;
+}
@@ -0,0 +1,120 @@
+#ifndef __RENDERQUEUE_HPP__
+#define __RENDERQUEUE_HPP__
+
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "includes/gl_include.h"
+#include "engine/geometrypool.hpp"
+#include "engine/streamring.hpp"
+#include "engine/shaders/loadshaders.hpp"
+
+/* Draws of one frame, recorded as packets between traversing the scene
+ * and issuing GL calls.  Each packet has a 64-bit key ordering it by
+ * pass, then program, vertex array, material and depth, front to back.
+ * Keys are radix sorted before submission, so packets sharing state are
+ * adjacent: consecutive pool draws become one multi-draw, and programs
+ * and vertex arrays already bound are not bound again.  A frame records
+ * at most 4096 passes; later passes are refused along with their
+ * packets.  Must be used from the GL thread.
+ */
+namespace engine
+{
+    /* Work done by the last submission: packets and passes submitted,
+     * passes refused past the limit, program and vertex array binds
+     * issued and skipped as redundant, and GL draw calls issued
+     */
+    struct queuestats
+    {
+        size_t packets, passes, refusedPasses;
+        size_t programBinds, vertexArrayBinds, skippedBinds;
+        size_t draws;
+
+        queuestats();
+    };
+
+    class renderqueue
+    {
+        public:
+            queuestats stats;
+
+            renderqueue();
+
+            /* drop the packets and passes recorded */
+            void clear();
+
+            /* start a pass drawn with p, after setup has set its other
+             * state, such as the framebuffer, textures and blending; p is
+             * bound when setup runs.  Packets recorded next belong to it.
+             * Returns false once the frame holds 4096 passes, dropping
+             * this pass and every packet recorded until clear.
+             */
+            bool beginPass(const program &p, std::function<void()> setup);
+
+            /* record a draw of pool geometry whose instances were added to
+             * the pool this frame, for a material at a distance from the
+             * viewpoint.  Draws recorded before any pass or after a
+             * refused one are dropped.
+             */
+            void addDraw(geometrypool &pool, GLuint materialIndex, float depth,
+                    const drawcommand &command);
+
+            /* record a draw of count vertices of a vertex array, dropped
+             * like addDraw's before any pass
+             */
+            void addArrays(GLuint vertexArray, GLuint count);
+
+            /* stream the pools' instances through ring, sort the packets
+             * and issue every pass in order
+             */
+            void submit(streamring &ring);
+
+        private:
+            struct pass
+            {
+                GLuint program;
+                size_t programIndex;
+                std::function<void()> setup;
+            };
+
+            /* a packet draws either commands of a pool or arrays of a
+             * vertex array
+             */
+            struct packet
+            {
+                geometrypool *pool;
+                GLuint vertexArray;
+                drawcommand command;
+            };
+
+            std::vector<pass> passes;
+            std::vector<packet> packets;
+
+            /* passes refused since clear; their packets are dropped */
+            size_t refusedPasses;
+
+            /* packet keys with their packet index, and scratch space for
+             * sorting them
+             */
+            std::vector<std::pair<uint64_t, uint32_t> > keys, sorted;
+
+            /* programs and vertex arrays seen this frame, numbered in the
+             * keys by their position
+             */
+            std::vector<GLuint> programs, vertexArrays;
+
+            /* commands of a run of packets drawn together */
+            std::vector<drawcommand> run;
+
+            /* state last bound by submit */
+            GLuint boundProgram, boundVertexArray;
+
+            uint64_t makeKey(GLuint vertexArray, GLuint materialIndex, float depth);
+            void sortKeys();
+            void bindProgram(GLuint id);
+            void bindVertexArray(GLuint id);
+    };
+}
+
+#endif  // ifndef __RENDERQUEUE_HPP__
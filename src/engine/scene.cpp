@@ -1,31 +1,61 @@
 #include "engine/scene.hpp"
-#include "engine/shaders/loadshaders.hpp"
+#include "engine/assetregistry.hpp"
+#include "engine/uniformblocks.hpp"
+#include "engine/geometrypool.hpp"
 #include <iostream>
+#include <cmath>
+#include <cstring>
+#include <map>
 
 #define SHADOW_MAP_WIDTH 2048
 #define SHADOW_MAP_HEIGHT 2048
 #define SHADOW_MAP_DEPTH 100
+#define UPLOAD_BYTES_PER_FRAME (4 << 20)
+
+// Per-frame data the stream ring holds before growing
+#define STREAM_BYTES_PER_FRAME (1 << 20)
+
+// Simplification error tolerated on screen and in the shadowmap, in pixels
+#define LOD_PIXEL_ERROR 1.0f
+#define SHADOW_LOD_PIXEL_ERROR 2.0f
 
 using namespace engine;
 
 scene::scene() :
+    windowWidth(),
+    windowHeight(),
+    shadowStats(),
+    litStats(),
+    queueStats(),
     meshes(),
     lights(),
+    batches(),
     projectionMatrix(),
-    invCamRotation(),
     invCamPosition(glm::vec4(0, 0, 0, 0)),
+    invCamRotation(),
     keysDown(),
     specialsDown(),
-    windowWidth(),
-    windowHeight(),
-    shadowmapSize(),
+    shadowProgram(),
+    renderProgram(),
+    canvasProgram(),
+    shadowInstanceTexture(),
+    instanceTexture(),
+    shadowmapTexture(),
+    materialTexture(),
+    canvasTexture(),
     shadowFramebuffer(),
-    shadowTexture(),
     sceneFramebuffer(),
+    shadowTexture(),
     sceneTexture(),
     sceneDepthbuffer(),
     canvasPosBuffer(),
-    canvasProgramID()
+    canvasVertexArray(),
+    ring(),
+    cameraSlice(),
+    lightSlice(),
+    lightStride(),
+    shadowmapSize(),
+    queue()
 {}
 
 scene::scene(std::vector<mesh> meshes,
@@ -34,107 +64,89 @@ scene::scene(std::vector<mesh> meshes,
         glm::mat4 camRotation,
         glm::vec3 camPosition,
         int windowWidth, int windowHeight) :
+    windowWidth(windowWidth),
+    windowHeight(windowHeight),
+    shadowStats(),
+    litStats(),
+    queueStats(),
     meshes(meshes),
     lights(lights),
+    batches(),
     projectionMatrix(projectionMatrix),
-    invCamRotation(glm::inverse(camRotation)),
     invCamPosition(glm::vec4(-camPosition, 1)),
+    invCamRotation(glm::inverse(camRotation)),
     keysDown(),
     specialsDown(),
-    windowWidth(windowWidth),
-    windowHeight(windowHeight),
-    shadowmapSize(glm::vec3(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, SHADOW_MAP_DEPTH)),
+    shadowProgram(),
+    renderProgram(),
+    canvasProgram(),
+    shadowInstanceTexture(),
+    instanceTexture(),
+    shadowmapTexture(),
+    materialTexture(),
+    canvasTexture(),
     shadowFramebuffer(),
-    shadowTexture(),
     sceneFramebuffer(),
-    sceneTexture(),
-    sceneDepthbuffer(),
-    canvasPosBuffer(),
-    canvasProgramID()
-{
-    initShaders();
-    initShadowBuffers();
-    initSceneBuffers();
-}
-
-scene::scene(const scene& s) :
-    meshes(s.meshes),
-    lights(s.lights),
-    projectionMatrix(s.projectionMatrix),
-    invCamRotation(s.invCamRotation),
-    invCamPosition(s.invCamPosition),
-    keysDown(s.keysDown),
-    specialsDown(s.specialsDown),
-    windowWidth(s.windowWidth),
-    windowHeight(s.windowHeight),
-    shadowmapSize(),
-    shadowFramebuffer(),
     shadowTexture(),
-    sceneFramebuffer(),
     sceneTexture(),
     sceneDepthbuffer(),
     canvasPosBuffer(),
-    canvasProgramID()
-{
-    initShaders();
-    initShadowBuffers();
-    initSceneBuffers();
-}
-
-scene& scene::operator=(const scene& s)
+    canvasVertexArray(),
+    ring(),
+    cameraSlice(),
+    lightSlice(),
+    lightStride(),
+    shadowmapSize(glm::vec3(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, SHADOW_MAP_DEPTH)),
+    queue()
 {
-    meshes = s.meshes;
-    lights = s.lights;
-    projectionMatrix = s.projectionMatrix;
-    invCamRotation = s.invCamRotation;
-    invCamPosition = s.invCamPosition;
-    keysDown = s.keysDown;
-    specialsDown = s.specialsDown;
-    windowWidth = s.windowWidth;
-    windowHeight = s.windowHeight;
-    shadowmapSize = s.shadowmapSize;
-
-    deleteGLData();
-
     initShaders();
     initShadowBuffers();
     initSceneBuffers();
-
-    return *this;
+    initUniformBuffers();
 }
 
-scene::~scene()
+void scene::initShaders()
 {
-    deleteGLData();
-}
+    // Rendering light depth map, with the attribute locations of the
+    // geometry pools' vertex arrays
+    std::vector<std::string> inAttributes = geometrypool::attributes();
+    std::vector<std::string> outAttributes;
 
-void scene::deleteGLData()
-{
-    glDeleteProgram(canvasProgramID);
-    glDeleteTextures(1, &shadowTexture);
-    glDeleteFramebuffers(1, &shadowFramebuffer);
-    glDeleteTextures(1, &sceneTexture);
-    glDeleteRenderbuffers(1, &sceneDepthbuffer);
-    glDeleteFramebuffers(1, &sceneFramebuffer);
-    glDeleteBuffers(1, &canvasPosBuffer);
-}
+    outAttributes.push_back("fragdepth");
+    shadowProgram.load("src/engine/shaders/pointlightmap.vert",
+            "src/engine/shaders/pointlightmap.frag", inAttributes, outAttributes);
+    glUniformBlockBinding(shadowProgram.id(),
+            glGetUniformBlockIndex(shadowProgram.id(), "lightBlock"), lightBinding);
+    shadowInstanceTexture = shadowProgram.find<GLint>("instances");
+
+    // Rendering image with one light
+    outAttributes.clear();
+    outAttributes.push_back("color");
+    renderProgram.load("src/engine/shaders/lambertian.vert",
+            "src/engine/shaders/lambertian.frag", inAttributes, outAttributes);
+    glUniformBlockBinding(renderProgram.id(),
+            glGetUniformBlockIndex(renderProgram.id(), "cameraBlock"), cameraBinding);
+    glUniformBlockBinding(renderProgram.id(),
+            glGetUniformBlockIndex(renderProgram.id(), "lightBlock"), lightBinding);
+    instanceTexture = renderProgram.find<GLint>("instances");
+    shadowmapTexture = renderProgram.find<GLint>("shadowmap");
+    materialTexture = renderProgram.find<GLint>("materials");
 
-void scene::initShaders()
-{
     // Rendering texture to screen
-    std::vector<std::string> inAttributes;
-    std::vector<std::string> outAttributes;
+    inAttributes.clear();
+    outAttributes.clear();
 
     inAttributes.push_back("canvasVertPos");
-    canvasProgramID = loadshaders("src/engine/shaders/canvas.vert",
+    canvasProgram.load("src/engine/shaders/canvas.vert",
             "src/engine/shaders/canvas.frag", inAttributes, outAttributes);
+    canvasTexture = canvasProgram.find<GLint>("sceneTexture");
 }
 
 void scene::initShadowBuffers()
 {
     // Set up depth texture
-    glGenTextures(1, &shadowTexture);
-    glBindTexture(GL_TEXTURE_2D, shadowTexture);
+    shadowTexture.create();
+    glBindTexture(GL_TEXTURE_2D, shadowTexture.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, shadowmapSize.x,
             shadowmapSize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -143,10 +155,10 @@ void scene::initShadowBuffers()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // Set up framebuffer
-    glGenFramebuffers(1, &shadowFramebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+    shadowFramebuffer.create();
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer.id());
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D, shadowTexture, 0);
+            GL_TEXTURE_2D, shadowTexture.id(), 0);
     glDrawBuffer(GL_NONE);
 
     int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -160,8 +172,8 @@ void scene::initShadowBuffers()
 void scene::initSceneBuffers()
 {
     // Set up texture
-    glGenTextures(1, &sceneTexture);
-    glBindTexture(GL_TEXTURE_2D, sceneTexture);
+    sceneTexture.create();
+    glBindTexture(GL_TEXTURE_2D, sceneTexture.id());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, windowWidth, windowHeight, 0,
             GL_RGB, GL_UNSIGNED_BYTE, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -170,18 +182,18 @@ void scene::initSceneBuffers()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // Set up depthbuffer
-    glGenRenderbuffers(1, &sceneDepthbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthbuffer);
+    sceneDepthbuffer.create();
+    glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthbuffer.id());
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
             windowWidth, windowHeight);
 
     // Set up framebuffer
-    glGenFramebuffers(1, &sceneFramebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    sceneFramebuffer.create();
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer.id());
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-            GL_RENDERBUFFER, sceneDepthbuffer);
+            GL_RENDERBUFFER, sceneDepthbuffer.id());
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-            GL_TEXTURE_2D, sceneTexture, 0);
+            GL_TEXTURE_2D, sceneTexture.id(), 0);
     glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
     int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -192,8 +204,8 @@ void scene::initSceneBuffers()
     }
 
     //  Set up canvas
-    glGenBuffers(1, &canvasPosBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, canvasPosBuffer);
+    canvasPosBuffer.create();
+    glBindBuffer(GL_ARRAY_BUFFER, canvasPosBuffer.id());
 
     static const GLfloat canvasPositions[] = {
         -1.0f, -1.0f, 0.0f,
@@ -205,105 +217,220 @@ void scene::initSceneBuffers()
     };
     glBufferData(GL_ARRAY_BUFFER, sizeof(canvasPositions), canvasPositions,
             GL_STATIC_DRAW);
+
+    canvasVertexArray.create();
+    glBindVertexArray(canvasVertexArray.id());
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glBindVertexArray(0);
+}
+
+void scene::initUniformBuffers()
+{
+    // Lights are bound at offsets into the ring, which must be multiples
+    // of the offset alignment
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    lightStride = (sizeof(lightblock) + alignment - 1)/alignment*alignment;
+
+    ring.reset(new streamring(STREAM_BYTES_PER_FRAME));
 }
 
 void scene::loadMeshes(std::vector<std::string> meshPaths,
         std::vector<glm::mat4> modelMatrices)
 {
-    int oldNumMeshes = meshes.size();
-    int newNumMeshes = oldNumMeshes + meshPaths.size();
-    meshes.resize(newNumMeshes);
+    int numNewMeshes = meshPaths.size();
+    meshes.reserve(meshes.size() + numNewMeshes);
 
-    for(int i = oldNumMeshes; i < newNumMeshes; i++)
+    for(int i = 0; i < numNewMeshes; i++)
     {
-        meshes[i] = mesh(meshPaths.at(i), modelMatrices[i]);
+        meshes.push_back(mesh(meshPaths.at(i), modelMatrices.at(i)));
+    }
+
+    std::cout << meshes.size() << " meshes share "
+        << assetregistry::instance().size() << " assets\n";
+}
+
+void scene::loadMeshesAsync(std::vector<std::string> meshPaths,
+        std::vector<glm::mat4> modelMatrices)
+{
+    int numNewMeshes = meshPaths.size();
+    meshes.reserve(meshes.size() + numNewMeshes);
+
+    for(int i = 0; i < numNewMeshes; i++)
+    {
+        meshes.push_back(mesh(assetregistry::instance().loadAsync(meshPaths.at(i)),
+                    modelMatrices.at(i)));
     }
 }
 
 void scene::draw()
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Stream assets loaded in the background within a per-frame budget
+    assetregistry::instance().uploadPending(UPLOAD_BYTES_PER_FRAME);
 
-    int numMeshes = meshes.size();
-    int numLights = lights.size();
+    // Swap in assets whose files changed on disk, within the same budget
+    assetregistry::instance().reloadChanged(UPLOAD_BYTES_PER_FRAME);
 
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    shadowStats = drawstats();
+    litStats = drawstats();
+    batchMeshes();
+    ring->beginFrame();
+    writeUniformBuffers();
+
+    // Every pass of every light is recorded before any is submitted, so
+    // the queue can order their draws by state
+    queue.clear();
+    int numLights = lights.size();
     for(int i = 0; i < numLights; i++)
     {
         // draw shadowmap for scene
-        drawShadowmap(lights.at(i));
+        queueShadowmap(i);
 
         // render scene to scene texture using shadowmap
-        drawToTexture(lights.at(i));
+        queueToTexture();
 
         // Draw blended scene texture to screen
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
-        drawSceneToScreen();
-        glDisable(GL_BLEND);
+        queueSceneToScreen();
     }
+    queue.submit(*ring);
+    queueStats = queue.stats;
+    glDisable(GL_BLEND);
 
+    ring->endFrame();
     glFlush();
     glutSwapBuffers();
 }
 
-void scene::drawShadowmap(light l)
+void scene::batchMeshes()
 {
-    // bind and clear depth texture
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
-    glViewport(0, 0, shadowmapSize.x, shadowmapSize.y);
-    static const GLfloat clearDepth[1] = {1.0f};
-    glClearBufferfv(GL_DEPTH, 0, clearDepth);
-
-    // render mesh depths from light perspective
+    // Batches are rebuilt every frame, since meshes become resident and
+    // move between frames
+    batches.clear();
+    std::map<asset*, size_t> batchIndices;
     int numMeshes = meshes.size();
     for(int i = 0; i < numMeshes; i++)
     {
-        meshes.at(i).drawShadowmap(l, shadowmapSize);
+        if(!meshes[i].isResident())
+        {
+            continue;
+        }
+        std::map<asset*, size_t>::iterator it = batchIndices.find(meshes[i].source());
+        if(it == batchIndices.end())
+        {
+            it = batchIndices.insert(std::make_pair(meshes[i].source(),
+                        batches.size())).first;
+            batches.push_back(meshbatch());
+            batches.back().geometry = meshes[i].source();
+        }
+        batches[it->second].instances.push_back(meshes[i].instance());
     }
 }
 
-void scene::drawToTexture(light l)
+void scene::writeUniformBuffers()
 {
-    // bind and clear scene texture
-    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
-    glViewport(0, 0, windowWidth, windowHeight);
-    static const GLuint clearColor[4] = {0, 0, 0, 0};
-    static const GLfloat clearDepth[1] = {1.0f};
-    glClearBufferuiv(GL_COLOR, 0, clearColor);
-    glClearBufferfv(GL_DEPTH, 0, clearDepth);
-
-    // render meshes to scene texture
-    int numMeshes = meshes.size();
-    for(int i = 0; i < numMeshes; i++)
+    // The camera and lights are the same for every mesh, so they are
+    // written once per frame into the ring and bound for all programs;
+    // lightStride is a multiple of the offset alignment blocks need
+    camerablock camera = {viewMatrix(), projectionMatrix};
+    cameraSlice = ring->write(&camera, sizeof(camera), lightStride);
+    glBindBufferRange(GL_UNIFORM_BUFFER, cameraBinding, cameraSlice.buffer,
+            cameraSlice.offset, sizeof(camera));
+
+    std::vector<char> blocks(lights.size()*lightStride);
+    for(size_t i = 0; i < lights.size(); i++)
+    {
+        lightblock block = lightblock();
+        block.position = lights[i].position;
+        block.diffuse = lights[i].diffuse;
+        block.specular = lights[i].specular;
+        block.shadowmapSize = shadowmapSize;
+        memcpy(&blocks[i*lightStride], &block, sizeof(block));
+    }
+    if(!blocks.empty())
     {
-        meshes.at(i).draw(viewMatrix(), projectionMatrix, l, shadowTexture,
-                shadowmapSize);
+        lightSlice = ring->write(&blocks[0], blocks.size(), lightStride);
     }
 }
 
-void scene::drawSceneToScreen()
+void scene::queueShadowmap(int lightIndex)
 {
-    // Prepare to draw to screen
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, windowWidth, windowHeight);
+    // bind this light's block, then bind and clear depth texture and
+    // point the program at the instances
+    queue.beginPass(shadowProgram, [this, lightIndex]()
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, lightBinding, lightSlice.buffer,
+                lightSlice.offset + lightIndex*lightStride, sizeof(lightblock));
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer.id());
+        glViewport(0, 0, shadowmapSize.x, shadowmapSize.y);
+        static const GLfloat clearDepth[1] = {1.0f};
+        glClearBufferfv(GL_DEPTH, 0, clearDepth);
+        glDisable(GL_BLEND);
+        shadowProgram.set(shadowInstanceTexture, geometrypool::instanceUnit);
+    });
 
-    // Set canvas program and vertices
-    glUseProgram(canvasProgramID);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, canvasPosBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    // render mesh depths from light perspective; the shadowmap spans pi
+    // radians vertically
+    float lodScale = shadowmapSize.y/(M_PI*SHADOW_LOD_PIXEL_ERROR);
+    for(size_t i = 0; i < batches.size(); i++)
+    {
+        shadowStats += batches[i].geometry->queueShadowmap(queue, batches[i].instances,
+                lights[lightIndex], shadowmapSize, lodScale);
+    }
+}
 
-    // Load scene texture to draw on canvas
-    GLuint textureLoc = glGetUniformLocation(canvasProgramID, "sceneTexture");
-    glUniform1i(textureLoc, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sceneTexture);
-
-    // Clear depth buffer and draw
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    
-    glDisableVertexAttribArray(0);
+void scene::queueToTexture()
+{
+    // bind and clear scene texture, bind the shadowmap and the material
+    // table, and point the program at the instances; the camera and light
+    // are in uniform buffers, and everything else in the pools
+    queue.beginPass(renderProgram, [this]()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer.id());
+        glViewport(0, 0, windowWidth, windowHeight);
+        static const GLuint clearColor[4] = {0, 0, 0, 0};
+        static const GLfloat clearDepth[1] = {1.0f};
+        glClearBufferuiv(GL_COLOR, 0, clearColor);
+        glClearBufferfv(GL_DEPTH, 0, clearDepth);
+
+        renderProgram.set(shadowmapTexture, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, shadowTexture.id());
+        renderProgram.set(materialTexture, 1);
+        geometrypool::bindMaterials(GL_TEXTURE1);
+        renderProgram.set(instanceTexture, geometrypool::instanceUnit);
+    });
+
+    // render meshes to scene texture, with the projected size of a unit
+    // at unit distance taken from the projection matrix
+    float lodScale = projectionMatrix[1][1]*windowHeight/(2*LOD_PIXEL_ERROR);
+    glm::mat4 view = viewMatrix();
+    for(size_t i = 0; i < batches.size(); i++)
+    {
+        litStats += batches[i].geometry->queueDraw(queue, batches[i].instances, view,
+                projectionMatrix, lodScale);
+    }
+}
+
+void scene::queueSceneToScreen()
+{
+    // Prepare to draw to screen, loading the scene texture to draw on the
+    // canvas and blending it over earlier lights
+    queue.beginPass(canvasProgram, [this]()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+
+        canvasProgram.set(canvasTexture, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneTexture.id());
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    });
+    queue.addArrays(canvasVertexArray.id(), 6);
 }
 
 
@@ -340,19 +467,20 @@ void scene::update()
     // Rotate meshes
     if(keysDown.find('x') != keysDown.end())
     {
-        int numMeshes = meshes.size();
-        for(int i = 0; i < numMeshes; i++)
-        {
-            meshes[i].rotate(2.0f, glm::vec3(0, 1, 0));
-        }
+        rotateMeshes(2.0f);
     }
     if(keysDown.find('z') != keysDown.end())
     {
-        int numMeshes = meshes.size();
-        for(int i = 0; i < numMeshes; i++)
-        {
-            meshes[i].rotate(-2.0f, glm::vec3(0, 1, 0));
-        }
+        rotateMeshes(-2.0f);
+    }
+}
+
+void scene::rotateMeshes(float angle)
+{
+    int numMeshes = meshes.size();
+    for(int i = 0; i < numMeshes; i++)
+    {
+        meshes[i].rotate(angle, glm::vec3(0, 1, 0));
     }
 }
 
@@ -4,11 +4,20 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <memory>
 
 #include "engine/mesh.hpp"
 #include "engine/light.hpp"
+#include "engine/shaders/loadshaders.hpp"
+#include "engine/globject.hpp"
+#include "engine/streamring.hpp"
+#include "engine/renderqueue.hpp"
 #include "includes/glm_include.hpp"
 
+/* The world drawn each frame: meshes, lights, the camera, and the GL
+ * objects of its passes.  Scenes own their GL objects, so they are moved
+ * rather than copied; moving one hands them over without GL calls.
+ */
 namespace engine
 {
     class scene
@@ -21,9 +30,8 @@ namespace engine
                     glm::mat4 camRotation,
                     glm::vec3 camPosition,
                     int windowWidth, int windowHeight);
-            scene(const scene& s);
-            scene& operator=(const scene& s);
-            ~scene();
+            scene(scene &&s) = default;
+            scene &operator=(scene &&s) = default;
 
             /* Load meshes from filepaths with given initial
              * model matrices
@@ -31,12 +39,21 @@ namespace engine
             void loadMeshes(std::vector<std::string> meshPaths,
                     std::vector<glm::mat4> modelMatrices);
 
+            /* Start loading meshes in the background and return at once.
+             * Each mesh is drawn once its asset is fully uploaded.
+             */
+            void loadMeshesAsync(std::vector<std::string> meshPaths,
+                    std::vector<glm::mat4> modelMatrices);
+
             /* draw scene to screne using shadow mapping */
             void draw();
 
             /* update scene from user input */
             void update();
 
+            /* rotate every mesh about its own y axis, in degrees */
+            void rotateMeshes(float angle);
+
             /* set user input */
             void setKey(int key);
             void setSpecial(int key);
@@ -45,11 +62,31 @@ namespace engine
 
             int windowWidth, windowHeight;
 
+            /* triangles, meshlets and draw commands submitted and culled
+             * in the last frame by the shadowmap and lit passes
+             */
+            drawstats shadowStats, litStats;
+
+            /* packets, binds and GL draw calls submitted in the last
+             * frame by the render queue
+             */
+            queuestats queueStats;
+
         private:
             /* scene object data */
             std::vector<mesh> meshes;
             std::vector<light> lights;
 
+            /* instances of each asset among the resident meshes, gathered
+             * once per frame so every pass draws them together
+             */
+            struct meshbatch
+            {
+                asset *geometry;
+                std::vector<meshinstance> instances;
+            };
+            std::vector<meshbatch> batches;
+
             /* matrix data */
             glm::mat4 projectionMatrix;
             glm::mat4 viewMatrix();
@@ -60,24 +97,47 @@ namespace engine
             std::set<int> keysDown;
             std::set<int> specialsDown;
 
-            /* programs and buffers for rendering */
-            GLuint canvasProgramID;
-            GLuint shadowFramebuffer, shadowTexture;
-            GLuint sceneFramebuffer, sceneTexture, sceneDepthbuffer;
-            GLuint canvasPosBuffer;
+            /* programs and buffers for rendering; the mesh programs take
+             * their vertex and instance attributes from the geometry pools
+             */
+            program shadowProgram, renderProgram, canvasProgram;
+            uniform<GLint> shadowInstanceTexture, instanceTexture;
+            uniform<GLint> shadowmapTexture, materialTexture, canvasTexture;
+            glframebuffer shadowFramebuffer, sceneFramebuffer;
+            gltexture shadowTexture, sceneTexture;
+            glrenderbuffer sceneDepthbuffer;
+            glbuffer canvasPosBuffer;
+            glvertexarray canvasVertexArray;
+
+            /* ring all per-frame data is streamed through: the camera
+             * and light blocks, each light lightStride bytes after the
+             * last, and the pools' instances and commands
+             */
+            std::unique_ptr<streamring> ring;
+            streamslice cameraSlice, lightSlice;
+            size_t lightStride;
 
             glm::vec3 shadowmapSize;
 
-            /* constructor and destructor helpers */
+            /* draws of every pass of the frame, sorted before submission */
+            renderqueue queue;
+
+            /* constructor helpers */
             void initShaders();
             void initShadowBuffers();
             void initSceneBuffers();
-            void deleteGLData();
+            void initUniformBuffers();
 
             /* draw function helpers */
-            void drawShadowmap(light l);
-            void drawToTexture(light l);
-            void drawSceneToScreen();
+            void batchMeshes();
+            void writeUniformBuffers();
+            void queueShadowmap(int lightIndex);
+            void queueToTexture();
+            void queueSceneToScreen();
+
+            /* scenes own their GL objects, so are not copyable */
+            scene(const scene& s);
+            scene& operator=(const scene& s);
     };
 }
 
@@ -10,13 +10,21 @@ in vec3 fragNormal;
 in vec3 lightDir;
 in vec3 halfViewDir;
 in vec3 shadowPos;
+flat in int fragMaterial;
 
-// Light and shadow data
-uniform vec3 lightDiffuse;
-uniform vec3 lightSpecular;
-uniform vec3 shadowmapSize;
+// Light and shadow data, shared by every mesh in a light pass
+layout(std140) uniform lightBlock
+{
+    vec3 lightPosition_worldspace;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec3 shadowmapSize;
+};
 uniform sampler2D shadowmap;
 
+// Materials of every asset, as diffuse and ambient texels
+uniform samplerBuffer materials;
+
 out vec3 color;
 
 void main()
@@ -49,6 +57,8 @@ void main()
     shadowScale = shadowScale/(size*size);
 
     // Apply scaled blinn phong shading
-    vec3 ambient = vec3(0.2f);
-    color = shadowScale*(lightDiffuse*diffuse + lightSpecular*specular + ambient);
+    vec3 materialDiffuse = texelFetch(materials, 2*fragMaterial).rgb;
+    vec3 ambient = vec3(0.2f) + texelFetch(materials, 2*fragMaterial + 1).rgb;
+    color = shadowScale*(materialDiffuse*lightDiffuse*diffuse +
+            lightSpecular*specular + ambient);
 }
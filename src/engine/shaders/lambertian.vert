@@ -10,26 +10,51 @@
 in vec3 vertexPosition_modelspace;
 in vec3 vertexNormal;
 
-// Light and shadow data
-uniform vec3 lightPosition_modelspace;
-uniform vec3 lightPosition_worldspace;
-uniform vec3 shadowmapSize;
+// Draw data: the decoding of quantized positions (identity for float
+// vertices), the material, and the first texel of the instances
+in vec3 positionOffset;
+in vec3 positionScale;
+in int materialIndex;
+in int firstInstance;
 
-// Transformation data
-uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
-uniform mat3 normalTransform;
+// Instances of every draw
+uniform samplerBuffer instances;
+
+// Camera data, shared by every mesh in a frame
+layout(std140) uniform cameraBlock
+{
+    mat4 V;
+    mat4 P;
+};
+
+// Light and shadow data, shared by every mesh in a light pass
+layout(std140) uniform lightBlock
+{
+    vec3 lightPosition_worldspace;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec3 shadowmapSize;
+};
 
 // Data for fragment shader
 out vec3 fragNormal;
 out vec3 lightDir;
 out vec3 halfViewDir;
 out vec3 shadowPos;
+flat out int fragMaterial;
 
 void main()
 {
-    vec4 pos_modelspace = vec4(vertexPosition_modelspace, 1);
+    // The instance's model transform and its normal transform, seven
+    // texels from the record's first
+    int texel = firstInstance + 7*gl_InstanceID;
+    mat4 M = mat4(texelFetch(instances, texel), texelFetch(instances, texel + 1),
+            texelFetch(instances, texel + 2), texelFetch(instances, texel + 3));
+    mat3 normalTransform = mat3(texelFetch(instances, texel + 4).xyz,
+            texelFetch(instances, texel + 5).xyz, texelFetch(instances, texel + 6).xyz);
+
+    vec3 position = positionOffset + positionScale*vertexPosition_modelspace;
+    vec4 pos_modelspace = vec4(position, 1);
     vec4 pos_worldspace = M*pos_modelspace;
     vec4 pos_cameraspace = V*pos_worldspace;
 
@@ -37,11 +62,16 @@ void main()
     lightDir = normalize(lightPosition_worldspace - pos_worldspace.xyz);
     halfViewDir = normalize(lightDir - normalize(pos_cameraspace).xyz);
 
-    vec3 pos_lightspace = vertexPosition_modelspace - lightPosition_modelspace;
+    // The light in model space; the transpose of normalTransform inverts
+    // the linear part of M
+    vec3 lightPosition_modelspace =
+        transpose(normalTransform)*(lightPosition_worldspace - M[3].xyz);
+    vec3 pos_lightspace = position - lightPosition_modelspace;
     float rho = length(pos_lightspace);
     float phi = 2*atan(pos_lightspace.y/(pos_lightspace.x + rho));
     float theta = acos(pos_lightspace.z/rho);
     shadowPos = vec3(phi/M_PI, 2*theta/M_PI - 1.0f, rho/shadowmapSize.z);
 
+    fragMaterial = materialIndex;
     gl_Position = P*pos_cameraspace;
 }
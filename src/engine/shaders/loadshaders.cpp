@@ -3,10 +3,38 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+
+using namespace engine;
+
+namespace
+{
+    /* read a shader file into a string */
+    std::string readshader(std::string path)
+    {
+        std::ifstream file(path.c_str());
+        if(!file)
+        {
+            std::cout << path << " does not exist!\n";
+            exit(1);
+        }
+        std::ostringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+}
 
 GLuint engine::loadshaders(std::string vertfile, std::string fragfile,
         std::vector<std::string> in_attributes,
         std::vector<std::string> out_attributes)
+{
+    return linkshaders(readshader(vertfile), readshader(fragfile), in_attributes,
+            out_attributes);
+}
+
+GLuint engine::linkshaders(std::string vertexString, std::string fragmentString,
+        std::vector<std::string> in_attributes,
+        std::vector<std::string> out_attributes)
 {
     /* init glew and load compiled shaders */
     glewInit();
@@ -19,28 +47,6 @@ GLuint engine::loadshaders(std::string vertfile, std::string fragfile,
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
     GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
-    /* read shader files into strings */
-    std::ifstream vfile(vertfile.c_str());
-    std::ifstream ffile(fragfile.c_str());
-
-    if(!vfile)
-    {
-        std::cout << vertfile << " does not exist!\n";
-        exit(1);
-    }
-    if(!ffile)
-    {
-        std::cout << fragfile << " does not exist!\n";
-        exit(1);
-    }
-
-    std::ostringstream vbuffer, fbuffer;
-    vbuffer << vfile.rdbuf();
-    fbuffer << ffile.rdbuf();
-    
-    std::string vertexString(vbuffer.str());
-    std::string fragmentString(fbuffer.str());
-
     /* convert strings to c_strings and set as shader source */
     char *vertexCString, *fragmentCString;
     vertexCString = new char[vertexString.length() + 1];
@@ -89,7 +95,11 @@ GLuint engine::loadshaders(std::string vertfile, std::string fragfile,
     int num_in_attributes = in_attributes.size();
     for(int i = 0; i < num_in_attributes; i++)
     {
-        glBindAttribLocation(program, i, in_attributes.at(i).c_str());
+        // Empty names leave a location unbound, e.g. for matrix columns
+        if(!in_attributes.at(i).empty())
+        {
+            glBindAttribLocation(program, i, in_attributes.at(i).c_str());
+        }
     }
     int num_out_attributes = out_attributes.size();
     for(int i = 0; i < num_out_attributes; i++)
@@ -112,3 +122,267 @@ GLuint engine::loadshaders(std::string vertfile, std::string fragfile,
 
     return program;
 }
+
+namespace
+{
+    /* whether uniforms of a GL type hold values of a C++ type */
+    bool holds(GLenum type, const GLint*)
+    {
+        switch(type)
+        {
+            case GL_INT:
+            case GL_BOOL:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_2D_SHADOW:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_BUFFER:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool holds(GLenum type, const GLfloat*)
+    {
+        return type == GL_FLOAT;
+    }
+
+    bool holds(GLenum type, const glm::vec3*)
+    {
+        return type == GL_FLOAT_VEC3;
+    }
+
+    bool holds(GLenum type, const glm::mat3*)
+    {
+        return type == GL_FLOAT_MAT3;
+    }
+
+    bool holds(GLenum type, const glm::mat4*)
+    {
+        return type == GL_FLOAT_MAT4;
+    }
+}
+
+uniformstats::uniformstats() :
+    issued(0),
+    skipped(0)
+{}
+
+uniformstats program::uploads;
+
+size_t program::linked()
+{
+    // Expired entries are only removed when their key is loaded again
+    size_t count = 0;
+    std::map<std::string, std::weak_ptr<linkedprogram> >::iterator it;
+    for(it = cache().begin(); it != cache().end(); ++it)
+    {
+        count += !it->second.expired();
+    }
+    return count;
+}
+
+program::program() :
+    shared()
+{}
+
+program::linkedprogram::linkedprogram(GLuint id) :
+    id(id),
+    uniforms(),
+    byName(),
+    values()
+{}
+
+program::linkedprogram::~linkedprogram()
+{
+    glDeleteProgram(id);
+}
+
+std::map<std::string, std::weak_ptr<program::linkedprogram> > &program::cache()
+{
+    static std::map<std::string, std::weak_ptr<linkedprogram> > programs;
+    return programs;
+}
+
+bool program::load(std::string vertfile, std::string fragfile,
+        std::vector<std::string> in_attributes,
+        std::vector<std::string> out_attributes)
+{
+    unload();
+
+    // Programs are keyed by what they are linked from, so shaders copied
+    // under another name share a program and edited files do not
+    std::string vertexString = readshader(vertfile);
+    std::string fragmentString = readshader(fragfile);
+    std::string key = vertexString + '\0' + fragmentString + '\0';
+    for(size_t i = 0; i < in_attributes.size(); i++)
+    {
+        key += in_attributes[i] + ',';
+    }
+    key += '\0';
+    for(size_t i = 0; i < out_attributes.size(); i++)
+    {
+        key += out_attributes[i] + ',';
+    }
+
+    std::weak_ptr<linkedprogram> &entry = cache()[key];
+    shared = entry.lock();
+    if(shared)
+    {
+        return true;
+    }
+    GLuint loaded = linkshaders(vertexString, fragmentString, in_attributes,
+            out_attributes);
+    if(loaded == GLuint(-1))
+    {
+        return false;
+    }
+    shared.reset(new linkedprogram(loaded));
+    reflect(*shared);
+    entry = shared;
+    return true;
+}
+
+void program::unload()
+{
+    shared.reset();
+}
+
+GLuint program::id() const
+{
+    return shared ? shared->id : 0;
+}
+
+GLint program::attribute(std::string name) const
+{
+    return glGetAttribLocation(id(), name.c_str());
+}
+
+void program::reflect(linkedprogram &p)
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(p.id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(p.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+    for(GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        uniforminfo info = {-1, 0, 0, false};
+        glGetActiveUniform(p.id, i, name.size(), &length, &size, &info.type,
+                &name[0]);
+
+        // Members of uniform blocks have no location and are set through
+        // their buffers instead
+        info.location = glGetUniformLocation(p.id, &name[0]);
+        if(info.location < 0)
+        {
+            continue;
+        }
+
+        // Arrays are found by their name without the subscript
+        std::string key(&name[0], length);
+        if(key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+        {
+            key.resize(key.size() - 3);
+        }
+        p.byName[key] = p.uniforms.size();
+        p.uniforms.push_back(info);
+    }
+}
+
+template<typename T> uniform<T> program::find(std::string name) const
+{
+    uniform<T> u;
+    if(!shared)
+    {
+        return u;
+    }
+    std::map<std::string, int>::const_iterator it = shared->byName.find(name);
+    if(it != shared->byName.end() &&
+            holds(shared->uniforms[it->second].type, (const T*)0))
+    {
+        u.index = it->second;
+    }
+    return u;
+}
+
+template uniform<GLint> program::find<GLint>(std::string name) const;
+template uniform<GLfloat> program::find<GLfloat>(std::string name) const;
+template uniform<glm::vec3> program::find<glm::vec3>(std::string name) const;
+template uniform<glm::mat3> program::find<glm::mat3>(std::string name) const;
+template uniform<glm::mat4> program::find<glm::mat4>(std::string name) const;
+
+void program::use() const
+{
+    glUseProgram(id());
+}
+
+bool program::changed(int index, const void *value, size_t size)
+{
+    if(index < 0)
+    {
+        return false;
+    }
+    // Values are cached with the shared program, since every handle to
+    // it sets the same GL state
+    std::vector<char> &values = shared->values;
+    uniforminfo &info = shared->uniforms[index];
+    if(!info.cached)
+    {
+        info.offset = values.size();
+        info.cached = true;
+        values.resize(values.size() + size);
+    }
+    else if(memcmp(&values[info.offset], value, size) == 0)
+    {
+        uploads.skipped++;
+        return false;
+    }
+    memcpy(&values[info.offset], value, size);
+    uploads.issued++;
+    return true;
+}
+
+void program::set(uniform<GLint> u, GLint value)
+{
+    if(changed(u.index, &value, sizeof(value)))
+    {
+        glUniform1i(shared->uniforms[u.index].location, value);
+    }
+}
+
+void program::set(uniform<GLfloat> u, GLfloat value)
+{
+    if(changed(u.index, &value, sizeof(value)))
+    {
+        glUniform1f(shared->uniforms[u.index].location, value);
+    }
+}
+
+void program::set(uniform<glm::vec3> u, const glm::vec3 &value)
+{
+    if(changed(u.index, &value[0], sizeof(value)))
+    {
+        glUniform3fv(shared->uniforms[u.index].location, 1, &value[0]);
+    }
+}
+
+void program::set(uniform<glm::mat3> u, const glm::mat3 &value)
+{
+    if(changed(u.index, &value[0][0], sizeof(value)))
+    {
+        glUniformMatrix3fv(shared->uniforms[u.index].location, 1, GL_FALSE,
+                &value[0][0]);
+    }
+}
+
+void program::set(uniform<glm::mat4> u, const glm::mat4 &value)
+{
+    if(changed(u.index, &value[0][0], sizeof(value)))
+    {
+        glUniformMatrix4fv(shared->uniforms[u.index].location, 1, GL_FALSE,
+                &value[0][0]);
+    }
+}
@@ -1,13 +1,138 @@
+#ifndef __LOADSHADERS_HPP__
+#define __LOADSHADERS_HPP__
+
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 #include "includes/gl_include.h"
+#include "includes/glm_include.hpp"
 
 /* Function for loading shaders into program.
- * Attribute locations are determined by ordering in vector.
+ * Attribute locations are determined by ordering in vector; empty names
+ * skip a location.
  */
 namespace engine
 {
     GLuint loadshaders(std::string vertfile, std::string fragfile,
             std::vector<std::string> in_attributes,
             std::vector<std::string> out_attributes);
+
+    /* As loadshaders, given the shader sources instead of their files */
+    GLuint linkshaders(std::string vertexString, std::string fragmentString,
+            std::vector<std::string> in_attributes,
+            std::vector<std::string> out_attributes);
+
+    /* Uniform uploads requested of all programs, as issued to GL or
+     * skipped because the uniform already held the value
+     */
+    struct uniformstats
+    {
+        size_t issued, skipped;
+
+        uniformstats();
+    };
+
+    /* Handle to an active uniform of a program, typed by the value it
+     * holds.  A default handle, or one to a uniform the program does not
+     * use, is valid and ignores values set through it.
+     */
+    template<typename T> class uniform
+    {
+        public:
+            uniform() : index(-1) {}
+
+        private:
+            int index;
+            friend class program;
+    };
+
+    /* Handle to a linked program and its active uniforms, found once when
+     * it is linked.  Programs are cached process-wide by their shader
+     * sources and attribute bindings, so handles loading the same shaders
+     * share one GL program, which is deleted with its last handle.
+     * Values set through uniform handles are cached with the program, and
+     * uploads of a value a uniform already holds are skipped.  Handles
+     * must be used from the GL thread.
+     */
+    class program
+    {
+        public:
+            static uniformstats uploads;
+
+            /* number of distinct programs currently linked */
+            static size_t linked();
+
+            program();
+
+            /* find or load, link and introspect a program as loadshaders
+             * does, replacing any loaded before; returns false if it
+             * failed
+             */
+            bool load(std::string vertfile, std::string fragfile,
+                    std::vector<std::string> in_attributes,
+                    std::vector<std::string> out_attributes);
+
+            /* release the program, deleting it if no other handle shares
+             * it
+             */
+            void unload();
+
+            GLuint id() const;
+
+            /* location of an active vertex attribute, or -1 */
+            GLint attribute(std::string name) const;
+
+            /* handle to a uniform by name, or a handle ignoring values if
+             * the program has no active uniform of that name and type
+             */
+            template<typename T> uniform<T> find(std::string name) const;
+
+            /* make this the current program */
+            void use() const;
+
+            /* upload a value to a uniform of the current program, unless
+             * it already holds it
+             */
+            void set(uniform<GLint> u, GLint value);
+            void set(uniform<GLfloat> u, GLfloat value);
+            void set(uniform<glm::vec3> u, const glm::vec3 &value);
+            void set(uniform<glm::mat3> u, const glm::mat3 &value);
+            void set(uniform<glm::mat4> u, const glm::mat4 &value);
+
+        private:
+            /* active uniforms outside of uniform blocks, with the offset
+             * of their last value in values once one is set
+             */
+            struct uniforminfo
+            {
+                GLint location;
+                GLenum type;
+                size_t offset;
+                bool cached;
+            };
+
+            /* a GL program shared by every handle loading it */
+            struct linkedprogram
+            {
+                GLuint id;
+                std::vector<uniforminfo> uniforms;
+                std::map<std::string, int> byName;
+                std::vector<char> values;
+
+                linkedprogram(GLuint id);
+                ~linkedprogram();
+            };
+            std::shared_ptr<linkedprogram> shared;
+
+            static std::map<std::string, std::weak_ptr<linkedprogram> > &cache();
+            static void reflect(linkedprogram &p);
+
+            /* whether a value differs from the cached value of a uniform,
+             * caching it if so
+             */
+            bool changed(int index, const void *value, size_t size);
+    };
 }
+
+#endif  // ifndef __LOADSHADERS_HPP__
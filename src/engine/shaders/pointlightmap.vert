@@ -10,18 +10,46 @@
 
 in vec3 vertexPosition_modelspace;
 
-uniform vec3 lightPosition_modelspace;
-uniform float shadowmapDepth;
+// Draw data: the decoding of quantized positions (identity for float
+// vertices) and the first texel of the instances
+in vec3 positionOffset;
+in vec3 positionScale;
+in int firstInstance;
+
+// Instances of every draw
+uniform samplerBuffer instances;
+
+// Light and shadowmap data, shared by every mesh in a light pass
+layout(std140) uniform lightBlock
+{
+    vec3 lightPosition_worldspace;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec3 shadowmapSize;
+};
 
 out float depth;
 
 void main()
 {
-    vec3 pos = vertexPosition_modelspace - lightPosition_modelspace;
+    // The instance's model transform and its normal transform, seven
+    // texels from the record's first
+    int texel = firstInstance + 7*gl_InstanceID;
+    mat4 M = mat4(texelFetch(instances, texel), texelFetch(instances, texel + 1),
+            texelFetch(instances, texel + 2), texelFetch(instances, texel + 3));
+    mat3 normalTransform = mat3(texelFetch(instances, texel + 4).xyz,
+            texelFetch(instances, texel + 5).xyz, texelFetch(instances, texel + 6).xyz);
+
+    vec3 position = positionOffset + positionScale*vertexPosition_modelspace;
+    // The light in model space; the transpose of normalTransform inverts
+    // the linear part of M
+    vec3 lightPosition_modelspace =
+        transpose(normalTransform)*(lightPosition_worldspace - M[3].xyz);
+    vec3 pos = position - lightPosition_modelspace;
 
     float rho = length(pos);
     float phi = 2*atan(pos.y/(pos.x + rho));
     float theta = acos(pos.z/rho);
-    depth = rho/shadowmapDepth;
-    gl_Position = vec4(phi/M_PI, 2*theta/M_PI - 1.0f, rho/shadowmapDepth, 1);
+    depth = rho/shadowmapSize.z;
+    gl_Position = vec4(phi/M_PI, 2*theta/M_PI - 1.0f, rho/shadowmapSize.z, 1);
 }
@@ -0,0 +1,276 @@
+#ifndef __SPILLFILE_HPP__
+#define __SPILLFILE_HPP__
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cstdio>
+#include <cstddef>
+
+/* Temporary files of fixed-size records for conversions whose data does
+ * not fit in memory.  Records are plain structs written as raw bytes, read
+ * back in order through a buffer, and sorted with a bounded amount of
+ * memory by spilling sorted runs and merging them.
+ */
+namespace engine
+{
+    /* records buffered by a reader or writer unless told otherwise */
+    const size_t spillBufferBytes = 1 << 16;
+
+    template <typename T>
+    class spillwriter
+    {
+        public:
+            spillwriter() :
+                out(0),
+                buffer(),
+                written(0),
+                failed(false)
+            {}
+
+            ~spillwriter()
+            {
+                close();
+            }
+
+            bool open(std::string path, size_t bufferBytes = spillBufferBytes)
+            {
+                close();
+                out = fopen(path.c_str(), "wb");
+                buffer.reserve(std::max<size_t>(bufferBytes/sizeof(T), 1));
+                written = 0;
+                failed = !out;
+                return out != 0;
+            }
+
+            void write(const T &record)
+            {
+                buffer.push_back(record);
+                written++;
+                if(buffer.size() == buffer.capacity())
+                {
+                    flush();
+                }
+            }
+
+            /* finish the file, returning whether every record was written */
+            bool close()
+            {
+                if(out)
+                {
+                    flush();
+                    failed = fclose(out) != 0 || failed;
+                    out = 0;
+                }
+                std::vector<T>().swap(buffer);
+                return !failed;
+            }
+
+            size_t count() const
+            {
+                return written;
+            }
+
+        private:
+            FILE *out;
+            std::vector<T> buffer;
+            size_t written;
+            bool failed;
+
+            void flush()
+            {
+                if(!buffer.empty() &&
+                        fwrite(&buffer[0], sizeof(T), buffer.size(), out) != buffer.size())
+                {
+                    failed = true;
+                }
+                buffer.clear();
+            }
+
+            /* writers own their file */
+            spillwriter(const spillwriter& w);
+            spillwriter& operator=(const spillwriter& w);
+    };
+
+    template <typename T>
+    class spillreader
+    {
+        public:
+            spillreader() :
+                in(0),
+                buffer(),
+                next(0)
+            {}
+
+            ~spillreader()
+            {
+                close();
+            }
+
+            bool open(std::string path, size_t bufferBytes = spillBufferBytes)
+            {
+                close();
+                in = fopen(path.c_str(), "rb");
+                buffer.reserve(std::max<size_t>(bufferBytes/sizeof(T), 1));
+                return in != 0;
+            }
+
+            /* read the next record, returning false at the end of the file */
+            bool read(T &record)
+            {
+                if(next == buffer.size())
+                {
+                    buffer.resize(buffer.capacity());
+                    buffer.resize(in ? fread(&buffer[0], sizeof(T), buffer.size(), in) : 0);
+                    next = 0;
+                    if(buffer.empty())
+                    {
+                        return false;
+                    }
+                }
+                record = buffer[next++];
+                return true;
+            }
+
+            void close()
+            {
+                if(in)
+                {
+                    fclose(in);
+                    in = 0;
+                }
+                std::vector<T>().swap(buffer);
+                next = 0;
+            }
+
+        private:
+            FILE *in;
+            std::vector<T> buffer;
+            size_t next;
+
+            /* readers own their file */
+            spillreader(const spillreader& r);
+            spillreader& operator=(const spillreader& r);
+    };
+
+    /* Sort the records of the file at path in place by less, holding at
+     * most about memoryLimit bytes of records at once.  Sorted runs are
+     * spilled next to the file and merged, several passes deep if there
+     * are too many runs to merge at once.  Returns false if a file cannot
+     * be read or written.
+     */
+    template <typename T, typename Less>
+    bool spillsort(std::string path, Less less, size_t memoryLimit)
+    {
+        // Sort memory-sized runs of the input into their own files
+        std::vector<std::string> runs;
+        {
+            spillreader<T> input;
+            if(!input.open(path))
+            {
+                return false;
+            }
+            std::vector<T> records;
+            records.reserve(std::max<size_t>(memoryLimit/sizeof(T), 1));
+            bool more = true;
+            while(more)
+            {
+                T record;
+                records.clear();
+                while(records.size() < records.capacity() &&
+                        (more = input.read(record)))
+                {
+                    records.push_back(record);
+                }
+                if(records.empty() && !runs.empty())
+                {
+                    break;
+                }
+
+                std::sort(records.begin(), records.end(), less);
+                char suffix[32];
+                snprintf(suffix, sizeof(suffix), ".run%u", unsigned(runs.size()));
+                runs.push_back(path + suffix);
+                spillwriter<T> run;
+                if(!run.open(runs.back()))
+                {
+                    return false;
+                }
+                for(size_t i = 0; i < records.size(); i++)
+                {
+                    run.write(records[i]);
+                }
+                if(!run.close())
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Merge as many runs at once as their read buffers allow, until
+        // one remains
+        size_t fanIn = std::max<size_t>(memoryLimit/spillBufferBytes, 2);
+        size_t merges = 0;
+        while(runs.size() > 1)
+        {
+            std::vector<std::string> merged;
+            for(size_t first = 0; first < runs.size(); first += fanIn)
+            {
+                size_t count = std::min(fanIn, runs.size() - first);
+                char suffix[32];
+                snprintf(suffix, sizeof(suffix), ".merge%u", unsigned(merges++));
+                merged.push_back(path + suffix);
+
+                // Queue the runs by their next record, smallest on top
+                std::vector<spillreader<T> > inputs(count);
+                std::vector<T> heads(count);
+                auto later = [&](size_t a, size_t b) {
+                    return less(heads[b], heads[a]);
+                };
+                std::priority_queue<size_t, std::vector<size_t>, decltype(later)> queue(later);
+                for(size_t i = 0; i < count; i++)
+                {
+                    if(!inputs[i].open(runs[first + i]))
+                    {
+                        return false;
+                    }
+                    if(inputs[i].read(heads[i]))
+                    {
+                        queue.push(i);
+                    }
+                }
+
+                spillwriter<T> output;
+                if(!output.open(merged.back()))
+                {
+                    return false;
+                }
+                while(!queue.empty())
+                {
+                    size_t i = queue.top();
+                    queue.pop();
+                    output.write(heads[i]);
+                    if(inputs[i].read(heads[i]))
+                    {
+                        queue.push(i);
+                    }
+                }
+                if(!output.close())
+                {
+                    return false;
+                }
+                for(size_t i = 0; i < count; i++)
+                {
+                    inputs[i].close();
+                    remove(runs[first + i].c_str());
+                }
+            }
+            runs.swap(merged);
+        }
+
+        return rename(runs[0].c_str(), path.c_str()) == 0;
+    }
+}
+
+#endif  // ifndef __SPILLFILE_HPP__
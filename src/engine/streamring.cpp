@@ -0,0 +1,147 @@
+#include "engine/streamring.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+// Regions start at multiples of this, the largest uniform buffer offset
+// alignment GL allows
+#define REGION_ALIGNMENT 256
+
+// Nanoseconds to block on a fence before checking it again
+#define FENCE_TIMEOUT 1000000
+
+using namespace engine;
+
+streamstats::streamstats() :
+    bytes(0),
+    fenceWaits(0),
+    grows(0)
+{}
+
+streamstats streamring::stats;
+bool streamring::persistentMapping = true;
+
+streamring::streamring(size_t regionSize) :
+    storage(),
+    mapping(0),
+    regionSize(0),
+    used(0),
+    region(regions - 1),
+    fences(),
+    retired()
+{
+    if(!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+    {
+        persistentMapping = false;
+    }
+    allocate(regionSize);
+}
+
+streamring::~streamring()
+{
+    for(int r = 0; r < regions; r++)
+    {
+        if(fences[r])
+        {
+            glDeleteSync(fences[r]);
+        }
+    }
+}
+
+void streamring::beginFrame()
+{
+    region = (region + 1) % regions;
+    waitFor(region);
+    retired[region].clear();
+    used = 0;
+}
+
+void streamring::endFrame()
+{
+    // Writes through the unsynchronized mapping rely on the fence; other
+    // writes are ordered by GL
+    if(mapping)
+    {
+        if(fences[region])
+        {
+            glDeleteSync(fences[region]);
+        }
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+streamslice streamring::write(const void *data, size_t size, size_t alignment)
+{
+    size_t start = (used + alignment - 1)/alignment*alignment;
+    if(start + size > regionSize)
+    {
+        // Commands of this frame may still read the full buffer, so it is
+        // kept until the frame's fence passes
+        retired[region].push_back(std::move(storage));
+        allocate(std::max(2*regionSize, size));
+        stats.grows++;
+        start = 0;
+    }
+
+    GLintptr offset = region*regionSize + start;
+    if(mapping)
+    {
+        memcpy(mapping + offset, data, size);
+    }
+    else
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+    used = start + size;
+    stats.bytes += size;
+
+    streamslice slice = {storage.id(), offset};
+    return slice;
+}
+
+void streamring::allocate(size_t size)
+{
+    regionSize = (size + REGION_ALIGNMENT - 1)/REGION_ALIGNMENT*REGION_ALIGNMENT;
+    storage.create();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id());
+    if(persistentMapping)
+    {
+        // Coherent writes are seen by the GPU without flushing
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, regions*regionSize, 0, flags);
+        mapping = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                    regions*regionSize, flags));
+    }
+    else
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, regions*regionSize, 0, GL_STREAM_DRAW);
+        mapping = 0;
+    }
+}
+
+void streamring::waitFor(int r)
+{
+    if(!fences[r])
+    {
+        return;
+    }
+
+    // Under normal load the fence passed frames ago; otherwise flush so
+    // it is sure to be signaled, and block until it is
+    GLenum result = glClientWaitSync(fences[r], 0, 0);
+    if(result == GL_TIMEOUT_EXPIRED)
+    {
+        stats.fenceWaits++;
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while(result == GL_TIMEOUT_EXPIRED)
+        {
+            result = glClientWaitSync(fences[r], flags, FENCE_TIMEOUT);
+            flags = 0;
+        }
+    }
+    glDeleteSync(fences[r]);
+    fences[r] = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef __STREAMRING_HPP__
+#define __STREAMRING_HPP__
+
+#include <vector>
+
+#include "includes/gl_include.h"
+#include "engine/globject.hpp"
+
+/* Ring buffer for data written once per frame, such as uniform blocks,
+ * instances and indirect commands.  The buffer is split into one region
+ * per frame in flight, and each frame writes into the next region once
+ * the fence of the frame that last used it has passed.  Where buffer
+ * storage is available the buffer stays mapped, so writes are plain
+ * copies; otherwise each write is a glBufferSubData into the region.
+ * Must be used from the GL thread.
+ */
+namespace engine
+{
+    /* Work done by rings: bytes written, times the CPU waited on a fence
+     * because the GPU was still reading a region, and times a ring grew
+     */
+    struct streamstats
+    {
+        size_t bytes, fenceWaits, grows;
+
+        streamstats();
+    };
+
+    /* Where a write landed: the buffer, which changes when the ring
+     * grows, and the byte offset in it
+     */
+    struct streamslice
+    {
+        GLuint buffer;
+        GLintptr offset;
+    };
+
+    class streamring
+    {
+        public:
+            static streamstats stats;
+
+            /* whether rings map their buffer persistently; may be turned
+             * off before the first ring is created, and is off without
+             * GL 4.4 or ARB_buffer_storage
+             */
+            static bool persistentMapping;
+
+            streamring(size_t regionSize);
+            ~streamring();
+
+            /* move on to the region of the next frame, waiting for the
+             * GPU to finish the frame that last used it
+             */
+            void beginFrame();
+
+            /* fence the commands using the current region */
+            void endFrame();
+
+            /* copy size bytes of data into the current region at an offset
+             * that is a multiple of alignment, growing the ring if the
+             * region is full
+             */
+            streamslice write(const void *data, size_t size, size_t alignment);
+
+        private:
+            static const int regions = 3;
+
+            glbuffer storage;
+            char *mapping;
+            size_t regionSize, used;
+            int region;
+
+            /* fences of the last frame written to each region, and buffers
+             * replaced by growing while that frame may still read them
+             */
+            GLsync fences[regions];
+            std::vector<glbuffer> retired[regions];
+
+            void allocate(size_t size);
+            void waitFor(int r);
+
+            /* rings own their buffer and fences, so are not copyable */
+            streamring(const streamring& r);
+            streamring& operator=(const streamring& r);
+    };
+}
+
+#endif  // ifndef __STREAMRING_HPP__
@@ -0,0 +1,38 @@
+#ifndef __TIMER_HPP__
+#define __TIMER_HPP__
+
+#include <chrono>
+
+/* Wall clock stopwatch used for load time reporting
+ */
+namespace engine
+{
+    class timer
+    {
+        public:
+            timer() :
+                start(std::chrono::steady_clock::now())
+            {}
+
+            void reset()
+            {
+                start = std::chrono::steady_clock::now();
+            }
+
+            double seconds() const
+            {
+                return std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+            }
+
+            double milliseconds() const
+            {
+                return seconds()*1000.0;
+            }
+
+        private:
+            std::chrono::steady_clock::time_point start;
+    };
+}
+
+#endif  // ifndef __TIMER_HPP__
@@ -0,0 +1,42 @@
+#ifndef __UNIFORMBLOCKS_HPP__
+#define __UNIFORMBLOCKS_HPP__
+
+#include "includes/gl_include.h"
+#include "includes/glm_include.hpp"
+
+/* Uniform blocks shared by the mesh programs.  The scene writes the
+ * camera once per frame and every light once per frame, and binds them
+ * at fixed binding points it assigns to the blocks of its programs.
+ */
+namespace engine
+{
+    /* uniform buffer binding points of the camera and the light being
+     * drawn
+     */
+    const GLuint cameraBinding = 0;
+    const GLuint lightBinding = 1;
+
+    /* std140 layout of cameraBlock in lambertian.vert */
+    struct camerablock
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+    };
+
+    /* std140 layout of lightBlock in lambertian.vert, lambertian.frag
+     * and pointlightmap.vert, where every vec3 is aligned to 16 bytes
+     */
+    struct lightblock
+    {
+        glm::vec3 position;
+        float padding0;
+        glm::vec3 diffuse;
+        float padding1;
+        glm::vec3 specular;
+        float padding2;
+        glm::vec3 shadowmapSize;
+        float padding3;
+    };
+}
+
+#endif  // ifndef __UNIFORMBLOCKS_HPP__
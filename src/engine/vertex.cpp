@@ -0,0 +1,38 @@
+#include "engine/vertex.hpp"
+
+#include "glm/gtc/packing.hpp"
+
+using namespace engine;
+
+bool engine::compactVertices = false;
+
+void engine::packvertices(const vertex *vertices, size_t count,
+        glm::vec3 boundsMin, glm::vec3 boundsMax,
+        std::vector<compactvertex> &packed)
+{
+    // Flat axes quantize to zero rather than dividing by zero
+    glm::vec3 extent = boundsMax - boundsMin;
+    glm::vec3 invExtent;
+    for(int i = 0; i < 3; i++)
+    {
+        invExtent[i] = extent[i] > 0 ? 1.0f/extent[i] : 0.0f;
+    }
+
+    packed.resize(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        const vertex &v = vertices[i];
+        compactvertex &c = packed[i];
+
+        glm::vec3 position = (v.position - boundsMin)*invExtent;
+        for(int j = 0; j < 3; j++)
+        {
+            c.position[j] = glm::packUnorm1x16(position[j]);
+        }
+        c.position[3] = 0;
+
+        c.normal = glm::packSnorm3x10_1x2(glm::vec4(v.normal, 0.0f));
+        c.uv[0] = glm::packHalf1x16(v.uv.x);
+        c.uv[1] = glm::packHalf1x16(v.uv.y);
+    }
+}
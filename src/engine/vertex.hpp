@@ -0,0 +1,42 @@
+#ifndef __VERTEX_HPP__
+#define __VERTEX_HPP__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "includes/glm_include.hpp"
+
+/* Vertex layouts shared by the mesh cache and GL buffers
+ */
+namespace engine
+{
+    /* full precision interleaved layout, 32 bytes */
+    struct vertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+
+    /* compact layout, 16 bytes: positions as 16-bit unsigned normalized
+     * values within the mesh bounds (the fourth is padding), normals as
+     * signed normalized GL_INT_2_10_10_10_REV, UVs as half floats
+     */
+    struct compactvertex
+    {
+        uint16_t position[4];
+        uint32_t normal;
+        uint16_t uv[2];
+    };
+
+    /* upload new assets in the compact layout instead of full floats */
+    extern bool compactVertices;
+
+    /* quantize vertices against the bounds of their positions */
+    void packvertices(const vertex *vertices, size_t count,
+            glm::vec3 boundsMin, glm::vec3 boundsMax,
+            std::vector<compactvertex> &packed);
+}
+
+#endif  // ifndef __VERTEX_HPP__
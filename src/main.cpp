@@ -3,10 +3,35 @@
 #include "input/input.hpp"
 #include "engine/scene.hpp"
 #include "engine/shaders/loadshaders.hpp"
+#include "engine/geometrypool.hpp"
+#include "engine/objparser.hpp"
+#include "engine/vertex.hpp"
+#include "engine/meshcache.hpp"
+#include "engine/timer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 engine::scene world;
 GLuint vertexBuffer;
 
+// Frame time reporting for benchmarks
+#define BENCHMARK_FRAMES 200
+bool benchmark = false;
+engine::timer frameTimer;
+int framesTimed = 0;
+
+// Load meshes baked by bin/bake instead of their OBJ sources
+bool bakedMeshes = false;
+
+// Replace the two test meshes with a grid of this many spinning copies
+#define GRID_SPACING_X 5.0f
+#define GRID_SPACING_Z 9.0f
+#define GRID_ROTATION 1.0f
+int gridInstances = 0;
+
 void initGL()
 {
     glEnable(GL_DEPTH_TEST);
@@ -15,10 +40,6 @@ void initGL()
     glEnable(GL_LINE_SMOOTH);
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-
-    GLuint vertexArrayID;
-    glGenVertexArrays(1, &vertexArrayID);
-    glBindVertexArray(vertexArrayID);
 }
 
 void initWorld(int windowWidth, int windowHeight)
@@ -44,9 +65,30 @@ void initWorld(int windowWidth, int windowHeight)
     std::vector<std::string> meshpaths;
     meshpaths.push_back("static/test_mesh.obj");
     meshpaths.push_back("static/test_mesh.obj");
+    for(size_t i = 0; bakedMeshes && i < meshpaths.size(); i++)
+    {
+        meshpaths[i] = engine::meshcache::bakedPath(meshpaths[i]);
+    }
 
-    // Set up initial rotation and translation
+    // Lay out copies of the first mesh in rows receding from the camera,
+    // which share one asset
     std::vector<glm::mat4> modelMatrices;
+    if(gridInstances > 0)
+    {
+        int columns = std::max(1, int(std::sqrt(float(gridInstances))));
+        meshpaths.assign(gridInstances, meshpaths[0]);
+        for(int i = 0; i < gridInstances; i++)
+        {
+            glm::vec3 position(GRID_SPACING_X*(i % columns - 0.5f*(columns - 1)),
+                    0.0f, -15.0f - GRID_SPACING_Z*(i / columns));
+            modelMatrices.push_back(glm::rotate(glm::translate(glm::mat4(), position),
+                        glm::radians(float(i)), glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+        world.loadMeshes(meshpaths, modelMatrices);
+        return;
+    }
+
+    // Set up initial rotation and translation
     glm::mat4 init;
     init = glm::rotate(
             glm::translate(init, glm::vec3(0.0f, 0.0f, -18.0f)),
@@ -65,6 +107,32 @@ void initWorld(int windowWidth, int windowHeight)
 void display()
 {
     world.draw();
+
+    if(benchmark && ++framesTimed == BENCHMARK_FRAMES)
+    {
+        std::cout << "Average frame time: "
+            << frameTimer.milliseconds()/BENCHMARK_FRAMES << " ms, "
+            << world.shadowStats.triangles << " shadow and "
+            << world.litStats.triangles << " lit triangles, "
+            << world.shadowStats.culledMeshlets << " shadow and "
+            << world.litStats.culledMeshlets << " lit meshlets culled, "
+            << world.litStats.instances << " of "
+            << world.litStats.instances + world.litStats.culledInstances
+            << " instances in view, "
+            << world.shadowStats.commands + world.litStats.commands << " commands in "
+            << world.queueStats.draws << " draw calls, "
+            << world.queueStats.programBinds << " program and "
+            << world.queueStats.vertexArrayBinds << " vertex array binds, "
+            << world.queueStats.skippedBinds << " skipped, "
+            << engine::program::uploads.issued/BENCHMARK_FRAMES << " uniform uploads and "
+            << engine::program::uploads.skipped/BENCHMARK_FRAMES << " skipped per frame, "
+            << engine::streamring::stats.bytes/BENCHMARK_FRAMES/1024 << " KB streamed per frame, "
+            << engine::streamring::stats.fenceWaits << " fence waits\n";
+        engine::program::uploads = engine::uniformstats();
+        engine::streamring::stats = engine::streamstats();
+        frameTimer.reset();
+        framesTimed = 0;
+    }
 }
 
 void reshape(int w, int h)
@@ -94,6 +162,10 @@ void specialUp(int key, int x, int y)
 
 void idle()
 {
+    if(gridInstances > 0)
+    {
+        world.rotateMeshes(GRID_ROTATION);
+    }
     world.update();
     glutPostRedisplay();
 }
@@ -104,6 +176,43 @@ int main(int argc, char **argv)
     int windowHeight = 512;
 
     glutInit(&argc, argv);
+
+    // Options for benchmarking: loader thread count (0 for all cores),
+    // compact vertex layout, periodic frame time reports, loading baked
+    // meshes, a grid of mesh instances, a draw call per command instead
+    // of multi-draw-indirect, and streaming without persistent mapping
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            engine::parserThreads = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "-compact") == 0)
+        {
+            engine::compactVertices = true;
+        }
+        else if(strcmp(argv[i], "-benchmark") == 0)
+        {
+            benchmark = true;
+        }
+        else if(strcmp(argv[i], "-baked") == 0)
+        {
+            bakedMeshes = true;
+        }
+        else if(strcmp(argv[i], "-instances") == 0 && i + 1 < argc)
+        {
+            gridInstances = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "-noindirect") == 0)
+        {
+            engine::geometrypool::multiDrawIndirect = false;
+        }
+        else if(strcmp(argv[i], "-nopersistent") == 0)
+        {
+            engine::streamring::persistentMapping = false;
+        }
+    }
+
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_3_2_CORE_PROFILE);
     glutInitWindowSize(windowWidth, windowHeight);
     glutCreateWindow("Project");
@@ -112,7 +221,11 @@ int main(int argc, char **argv)
     glewInit();
 
     initGL();
+
+    engine::timer startup;
     initWorld(windowWidth, windowHeight);
+    std::cout << "Startup took " << startup.milliseconds() << " ms, "
+        << engine::program::linked() << " shader programs linked\n";
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
@@ -0,0 +1,170 @@
+/* Offline converter from OBJ and MTL sources to baked meshes, the
+ * load-ready binary format the engine maps without any processing.
+ *
+ * usage: bin/bake [-threads N] [-float] [-force] [-memory MB] [-compress]
+ *                 <file.obj | directory>...
+ *
+ * Every OBJ file named or found under a directory is baked next to its
+ * source as a .mesh file, skipping those whose baked mesh is newer than
+ * both OBJ and MTL.  Files are baked in parallel, one per thread.  With
+ * -memory, files are converted out of core so that all bakes together
+ * stay within MB megabytes, for meshes larger than memory.  With
+ * -compress, vertices and indices are stored compressed, to be decoded
+ * when the mesh is loaded.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "engine/meshbuild.hpp"
+#include "engine/meshstream.hpp"
+#include "engine/meshcache.hpp"
+#include "engine/objparser.hpp"
+#include "engine/parallel.hpp"
+#include "engine/timer.hpp"
+#include "engine/memoryusage.hpp"
+
+namespace
+{
+    bool isObjPath(const std::string &path)
+    {
+        return path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0;
+    }
+
+    /* Add path if it is an OBJ file, or every OBJ file below it if it is
+     * a directory
+     */
+    void findSources(std::string path, std::vector<std::string> &sources)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+        {
+            std::cerr << path << " not found!\n";
+            return;
+        }
+        if(!S_ISDIR(st.st_mode))
+        {
+            if(isObjPath(path))
+            {
+                sources.push_back(path);
+            }
+            return;
+        }
+
+        DIR *dir = opendir(path.c_str());
+        if(!dir)
+        {
+            return;
+        }
+        while(struct dirent *entry = readdir(dir))
+        {
+            if(entry->d_name[0] != '.')
+            {
+                findSources(path + "/" + entry->d_name, sources);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int threads = 0;
+    bool compact = true;
+    bool force = false;
+    size_t memoryLimit = 0;
+    bool compressed = false;
+    std::vector<std::string> sources;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-float") == 0)
+        {
+            compact = false;
+        }
+        else if(strcmp(argv[i], "-force") == 0)
+        {
+            force = true;
+        }
+        else if(strcmp(argv[i], "-memory") == 0 && i + 1 < argc)
+        {
+            memoryLimit = size_t(atoi(argv[++i])) << 20;
+        }
+        else if(strcmp(argv[i], "-compress") == 0)
+        {
+            compressed = true;
+        }
+        else
+        {
+            findSources(argv[i], sources);
+        }
+    }
+    if(sources.empty())
+    {
+        std::cerr << "usage: " << argv[0]
+            << " [-threads N] [-float] [-force] [-memory MB] [-compress]"
+            << " <file.obj | directory>...\n";
+        return 1;
+    }
+
+    // Files are the unit of parallelism, so each is parsed on one thread
+    engine::parserThreads = 1;
+    engine::timer clock;
+
+    // Concurrent out-of-core bakes share the memory ceiling
+    size_t workers = std::min<size_t>(engine::resolveThreads(threads), sources.size());
+    size_t jobMemory = memoryLimit/workers;
+    std::atomic<int> baked(0), current(0), failed(0);
+    {
+        engine::workerpool pool(threads);
+        for(size_t i = 0; i < sources.size(); i++)
+        {
+            std::string objpath = sources[i];
+            pool.submit([&, objpath]() {
+                std::string path = engine::meshcache::bakedPath(objpath);
+
+                // Incremental: keep baked meshes whose sources are unchanged
+                engine::meshcache existing;
+                if(!force && existing.open(objpath, path) &&
+                        existing.isCompact() == compact &&
+                        existing.isCompressed() == compressed)
+                {
+                    current++;
+                    return;
+                }
+
+                engine::meshcache geometry;
+                bool built = memoryLimit > 0 ?
+                    engine::streammesh(objpath, path, compact, compressed, jobMemory,
+                            geometry) :
+                    engine::buildmesh(objpath, path, compact, compressed, geometry);
+                if(built && geometry.isMapped())
+                {
+                    baked++;
+                }
+                else
+                {
+                    std::cerr << objpath << ": bake failed\n";
+                    failed++;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    std::cout << baked << " baked, " << current << " up to date, " << failed
+        << " failed in " << clock.milliseconds() << " ms, peak RSS "
+        << (engine::peakResidentBytes() >> 20) << " MB\n";
+    return failed > 0 ? 1 : 0;
+}
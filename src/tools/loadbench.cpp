@@ -0,0 +1,431 @@
+/* Benchmark of the mesh loading pipeline on generated OBJ files.
+ *
+ * usage: bin/loadbench [-triangles N,N,...] [-runs N] [-dir path] [-verbose]
+ *
+ * For every triangle count, a torus of about that many triangles is
+ * written to dir as OBJ and MTL files in the v/vt/vn face form of
+ * static/test_mesh.obj, with four material bands, unless already there.
+ * Each file is then loaded like a cold asset::loadMesh, timing every
+ * stage separately: parse, dedup, optimize, simplify, meshlets, store
+ * and upload.  There is no GL context, so upload is the copy of vertex
+ * and index data into freshly allocated buffers that glBufferData would
+ * make.  Results are printed as JSON: per stage the median, minimum and
+ * maximum milliseconds over the runs, throughput in MB of OBJ per
+ * second, and heap allocations and bytes of the first run, plus the
+ * process peak RSS after each size.  Sizes run smallest first, so the
+ * peak RSS of a size is mostly its own.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "engine/objparser.hpp"
+#include "engine/meshindex.hpp"
+#include "engine/meshoptimize.hpp"
+#include "engine/meshsimplify.hpp"
+#include "engine/meshlet.hpp"
+#include "engine/meshcache.hpp"
+#include "engine/timer.hpp"
+#include "engine/memoryusage.hpp"
+
+namespace
+{
+    std::atomic<size_t> allocationCount(0);
+    std::atomic<size_t> allocatedBytes(0);
+}
+
+// Every heap allocation is counted, from any thread
+void *operator new(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    void *p = malloc(size == 0 ? 1 : size);
+    if(!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    const size_t maxTriangles = 50000000;
+    const int materialBands = 4;
+
+    /* Timings and allocations of one stage */
+    struct stage
+    {
+        const char *name;
+        std::vector<double> milliseconds;
+        size_t allocations, bytes;
+    };
+
+    /* Measures one stage of one run into a stage record */
+    class stageclock
+    {
+        public:
+            stageclock(stage &record, bool first) :
+                record(record),
+                first(first),
+                allocations(allocationCount),
+                bytes(allocatedBytes),
+                clock()
+            {}
+
+            ~stageclock()
+            {
+                record.milliseconds.push_back(clock.milliseconds());
+                if(first)
+                {
+                    record.allocations = allocationCount - allocations;
+                    record.bytes = allocatedBytes - bytes;
+                }
+            }
+
+        private:
+            stage &record;
+            bool first;
+            size_t allocations, bytes;
+            engine::timer clock;
+    };
+
+    bool fileSize(std::string path, size_t &size)
+    {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        size = st.st_size;
+        return true;
+    }
+
+    /* Write a torus of about triangles triangles, split into material
+     * bands around its major circle; uvs are duplicated along the seams
+     * as modelling tools export them
+     */
+    bool generateObj(std::string objpath, std::string mtlname, size_t triangles)
+    {
+        size_t minor = std::max<size_t>(3, size_t(std::sqrt(triangles/4.0)));
+        size_t major = std::max<size_t>(3, (triangles + 2*minor - 1)/(2*minor));
+        const double pi = 3.14159265358979323846;
+
+        std::string temppath = objpath + ".tmp";
+        FILE *out = fopen(temppath.c_str(), "wb");
+        if(!out)
+        {
+            return false;
+        }
+        fprintf(out, "# Generated by loadbench\n\nmtllib %s\ng default\n", mtlname.c_str());
+        for(size_t i = 0; i < major; i++)
+        {
+            double u = 2.0*pi*i/major;
+            for(size_t j = 0; j < minor; j++)
+            {
+                double v = 2.0*pi*j/minor;
+                double ring = 3.0 + std::cos(v);
+                fprintf(out, "v %f %f %f\n", ring*std::cos(u), std::sin(v), ring*std::sin(u));
+            }
+        }
+        for(size_t i = 0; i <= major; i++)
+        {
+            for(size_t j = 0; j <= minor; j++)
+            {
+                fprintf(out, "vt %f %f\n", double(i)/major, double(j)/minor);
+            }
+        }
+        for(size_t i = 0; i < major; i++)
+        {
+            double u = 2.0*pi*i/major;
+            for(size_t j = 0; j < minor; j++)
+            {
+                double v = 2.0*pi*j/minor;
+                fprintf(out, "vn %f %f %f\n", std::cos(v)*std::cos(u), std::sin(v),
+                        std::cos(v)*std::sin(u));
+            }
+        }
+
+        int band = -1;
+        for(size_t i = 0; i < major; i++)
+        {
+            if(int(i*materialBands/major) != band)
+            {
+                band = i*materialBands/major;
+                fprintf(out, "usemtl band%d\n", band);
+            }
+            for(size_t j = 0; j < minor; j++)
+            {
+                // Corners of the quad: positions and normals wrap, uvs do not
+                size_t p[4] = {i*minor + j, i*minor + (j + 1) % minor,
+                    (i + 1) % major*minor + j, (i + 1) % major*minor + (j + 1) % minor};
+                size_t t[4] = {i*(minor + 1) + j, i*(minor + 1) + j + 1,
+                    (i + 1)*(minor + 1) + j, (i + 1)*(minor + 1) + j + 1};
+                fprintf(out, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                        p[0] + 1, t[0] + 1, p[0] + 1, p[1] + 1, t[1] + 1, p[1] + 1,
+                        p[3] + 1, t[3] + 1, p[3] + 1);
+                fprintf(out, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+                        p[3] + 1, t[3] + 1, p[3] + 1, p[2] + 1, t[2] + 1, p[2] + 1,
+                        p[0] + 1, t[0] + 1, p[0] + 1);
+            }
+        }
+        bool written = !ferror(out);
+        written = fclose(out) == 0 && written;
+        if(!written || rename(temppath.c_str(), objpath.c_str()) != 0)
+        {
+            remove(temppath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool generateMtl(std::string mtlpath)
+    {
+        FILE *out = fopen(mtlpath.c_str(), "wb");
+        if(!out)
+        {
+            return false;
+        }
+        for(int band = 0; band < materialBands; band++)
+        {
+            fprintf(out, "newmtl band%d\nillum 4\nKd %.2f 0.50 0.50\nKa 0.00 0.00 0.00\n\n",
+                    band, 0.2 + 0.2*band);
+        }
+        return fclose(out) == 0;
+    }
+
+    /* Load objpath the way a cold asset::loadMesh does, one stage at a
+     * time, returning false if it cannot be parsed
+     */
+    bool loadStages(std::string objpath, std::string mtlpath, std::vector<stage> &stages,
+            bool first, size_t &triangles, size_t &vertexCount)
+    {
+        engine::objdata obj;
+        engine::meshdata mesh;
+        std::vector<engine::vertex> &vertices = mesh.vertices;
+        std::vector<uint32_t> &indices = mesh.indices;
+        {
+            stageclock clock(stages[0], first);
+            if(!engine::parseobj(objpath, obj))
+            {
+                return false;
+            }
+        }
+        {
+            stageclock clock(stages[1], first);
+            if(!engine::indexcorners(obj, vertices, indices))
+            {
+                return false;
+            }
+        }
+        {
+            stageclock clock(stages[2], first);
+            std::vector<uint32_t> groups(indices.size()/3, obj.materials.size());
+            for(size_t r = 0; r < obj.materialRuns.size(); r++)
+            {
+                size_t end = r + 1 < obj.materialRuns.size() ?
+                    obj.materialRuns[r + 1].firstCorner : obj.corners.size();
+                std::fill(groups.begin() + obj.materialRuns[r].firstCorner/3,
+                        groups.begin() + end/3, obj.materialRuns[r].material);
+            }
+            engine::sortbygroup(indices, groups);
+            engine::groupranges(groups, 0, mesh.ranges);
+            engine::optimizemesh(vertices, indices, mesh.ranges);
+        }
+        bool closed;
+        {
+            stageclock clock(stages[3], first);
+            closed = engine::isclosed(vertices, indices);
+            engine::buildlods(vertices, indices, mesh.ranges, mesh.lods);
+        }
+        {
+            stageclock clock(stages[4], first);
+            engine::buildmeshlets(vertices, indices, mesh.ranges, closed,
+                    mesh.meshlets, mesh.rangeMeshlets);
+        }
+        engine::material fallback = {glm::vec4(1.0f), glm::vec4(0.0f)};
+        mesh.materials.assign(obj.materials.size() + 1, fallback);
+        engine::meshcache geometry;
+        {
+            stageclock clock(stages[5], first);
+            geometry.store(engine::meshcache::cachePath(objpath), objpath, mtlpath,
+                    mesh, false, false);
+        }
+        {
+            // What glBufferData copies out of the cache mapping
+            stageclock clock(stages[6], first);
+            size_t vertexBytes = geometry.vertexCount()*sizeof(engine::vertex);
+            size_t indexBytes = geometry.indexCount()*geometry.indexSize();
+            std::vector<char> vertexBuffer(vertexBytes), indexBuffer(indexBytes);
+            if(vertexBytes > 0)
+            {
+                memcpy(&vertexBuffer[0], geometry.vertices(), vertexBytes);
+            }
+            if(indexBytes > 0)
+            {
+                memcpy(&indexBuffer[0], geometry.indices(), indexBytes);
+            }
+        }
+        remove(engine::meshcache::cachePath(objpath).c_str());
+        triangles = obj.corners.size()/3;
+        vertexCount = vertices.size();
+        return true;
+    }
+
+    double median(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        size_t middle = values.size()/2;
+        return values.size() % 2 ? values[middle] :
+            0.5*(values[middle - 1] + values[middle]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> sizes;
+    int runs = 1;
+    bool verbose = false;
+    std::string directory = "bench";
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-triangles") == 0 && i + 1 < argc)
+        {
+            std::istringstream list(argv[++i]);
+            std::string item;
+            while(getline(list, item, ','))
+            {
+                sizes.push_back(strtoul(item.c_str(), 0, 10));
+            }
+        }
+        else if(strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+        {
+            runs = std::max(1, atoi(argv[++i]));
+        }
+        else if(strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if(strcmp(argv[i], "-verbose") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                << " [-triangles N,N,...] [-runs N] [-dir path] [-verbose]\n";
+            return 1;
+        }
+    }
+    if(sizes.empty())
+    {
+        size_t defaults[] = {1000, 10000, 100000, 1000000};
+        sizes.assign(defaults, defaults + 4);
+    }
+    for(size_t i = 0; i < sizes.size(); i++)
+    {
+        if(sizes[i] == 0 || sizes[i] > maxTriangles)
+        {
+            std::cerr << "triangle counts must be between 1 and " << maxTriangles << "\n";
+            return 1;
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+
+    mkdir(directory.c_str(), 0755);
+    std::string mtlpath = directory + "/loadbench.mtl";
+    if(!generateMtl(mtlpath))
+    {
+        std::cerr << mtlpath << ": could not write\n";
+        return 1;
+    }
+
+    // Engine logging would interleave with the JSON report
+    std::streambuf *console = std::cout.rdbuf();
+
+    const char *names[] = {"parse", "dedup", "optimize", "simplify", "meshlets",
+        "store", "upload"};
+    const size_t stageCount = sizeof(names)/sizeof(names[0]);
+    std::ostringstream report;
+    report << "{\n  \"benchmark\": \"loadmesh\",\n  \"runs\": " << runs
+        << ",\n  \"results\": [";
+    for(size_t s = 0; s < sizes.size(); s++)
+    {
+        std::ostringstream name;
+        name << directory << "/torus_" << sizes[s] << ".obj";
+        std::string objpath = name.str();
+        size_t objBytes;
+        if(!fileSize(objpath, objBytes) && !generateObj(objpath, "loadbench.mtl", sizes[s]))
+        {
+            std::cerr << objpath << ": could not write\n";
+            return 1;
+        }
+        fileSize(objpath, objBytes);
+
+        std::vector<stage> stages(stageCount);
+        for(size_t i = 0; i < stageCount; i++)
+        {
+            stages[i].name = names[i];
+            stages[i].allocations = stages[i].bytes = 0;
+        }
+        size_t triangles = 0, vertexCount = 0;
+        for(int run = 0; run < runs; run++)
+        {
+            if(!verbose)
+            {
+                std::cout.rdbuf(0);
+            }
+            bool loaded = loadStages(objpath, mtlpath, stages, run == 0, triangles,
+                    vertexCount);
+            std::cout.rdbuf(console);
+            std::cout.clear();
+            if(!loaded)
+            {
+                std::cerr << objpath << ": load failed\n";
+                return 1;
+            }
+        }
+
+        double total = 0.0;
+        report << (s ? "," : "") << "\n    {\n      \"obj\": \"" << objpath
+            << "\",\n      \"obj_bytes\": " << objBytes
+            << ",\n      \"triangles\": " << triangles
+            << ",\n      \"vertices\": " << vertexCount
+            << ",\n      \"stages\": {";
+        for(size_t i = 0; i < stageCount; i++)
+        {
+            const stage &st = stages[i];
+            double ms = median(st.milliseconds);
+            total += ms;
+            report << (i ? "," : "") << "\n        \"" << st.name << "\": {"
+                << "\"ms\": " << ms
+                << ", \"min_ms\": " << *std::min_element(st.milliseconds.begin(), st.milliseconds.end())
+                << ", \"max_ms\": " << *std::max_element(st.milliseconds.begin(), st.milliseconds.end())
+                << ", \"mb_per_s\": " << (ms > 0.0 ? objBytes/1048576.0/(ms/1000.0) : 0.0)
+                << ", \"allocations\": " << st.allocations
+                << ", \"allocated_bytes\": " << st.bytes << "}";
+        }
+        report << "\n      },\n      \"total_ms\": " << total
+            << ",\n      \"mb_per_s\": " << (total > 0.0 ? objBytes/1048576.0/(total/1000.0) : 0.0)
+            << ",\n      \"peak_rss_bytes\": " << engine::peakResidentBytes()
+            << "\n    }";
+    }
+    report << "\n  ]\n}\n";
+    std::cout << report.str();
+    return 0;
+}